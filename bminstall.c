@@ -4,6 +4,8 @@
 
 #include "mbr.h"
 #include "boot.h"
+#include "chaindir.h"
+#include "resultbuf.h"
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,8 +22,11 @@
 void usage()
 {
 	fprintf(stderr, "Usage: %s [option] [install_device]\n", PROGRAM_NAME);
-	fprintf(stderr, "  -p, --payload    payload to use\n");
-	fprintf(stderr, "  -h, --help       give this help list\n");
+	fprintf(stderr, "  -p, --payload       payload to use, several go behind payload/chain\n");
+	fprintf(stderr, "  -z, --lz4           compress the payload, unpacked at boot\n");
+	fprintf(stderr, "  -a, --run-all       several payloads: run all of them, no menu\n");
+	fprintf(stderr, "  -d, --dump-results  print the results region of install_device\n");
+	fprintf(stderr, "  -h, --help          give this help list\n");
 }
 
 static inline int safe_open(const char *path, int oflag)
@@ -99,15 +104,273 @@ void assert_rw_access(const char *filepath)
 	}
 }
 
-void install_legacy_boot(const char *device, const char *payload)
+#define LZ4_HASH_BITS  12
+#define LZ4_MIN_MATCH  4
+#define LZ4_MF_LIMIT   12 /* no match starts in the last 12 bytes */
+#define LZ4_LAST_LITS  5  /* and the last 5 are literals */
+
+static inline uint32_t read_u32(const unsigned char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static unsigned char *lz4_len(unsigned char *op, size_t len)
+{
+	for (; len >= 255; len -= 255) {
+		*op++ = 255;
+	}
+
+	*op++ = (unsigned char) len;
+	return op;
+}
+
+static unsigned char *lz4_sequence(unsigned char *op, const unsigned char *lit,
+	size_t nlit, size_t offset, size_t mlen)
+{
+	unsigned char *token = op++;
+
+	*token = (unsigned char) ((nlit < 15 ? nlit : 15) << 4);
+	if (nlit >= 15) {
+		op = lz4_len(op, nlit - 15);
+	}
+
+	memcpy(op, lit, nlit);
+	op += nlit;
+
+	if (!mlen) {
+		return op;
+	}
+
+	*op++ = (unsigned char) offset;
+	*op++ = (unsigned char) (offset >> 8);
+	mlen -= LZ4_MIN_MATCH;
+	*token |= (unsigned char) (mlen < 15 ? mlen : 15);
+	if (mlen >= 15) {
+		op = lz4_len(op, mlen - 15);
+	}
+
+	return op;
+}
+
+/* lz4 block, greedy with a single-entry hash; dst holds lz4_bound(n) */
+static size_t lz4_bound(size_t n)
+{
+	return n + n / 255 + 16;
+}
+
+static size_t lz4_compress(const unsigned char *src, size_t n, unsigned char *dst)
+{
+	static uint32_t table[1 << LZ4_HASH_BITS];
+	size_t ip = 0, anchor = 0, ref, len;
+	unsigned char *op = dst;
+	uint32_t h;
+
+	memset(table, 0, sizeof(table));
+	while (n > LZ4_MF_LIMIT && ip < n - LZ4_MF_LIMIT) {
+		h = (read_u32(src + ip) * 2654435761u) >> (32 - LZ4_HASH_BITS);
+		ref = table[h];
+		table[h] = (uint32_t) ip + 1;
+
+		if (!ref-- || ip - ref > 0xffff || read_u32(src + ref) != read_u32(src + ip)) {
+			ip++;
+			continue;
+		}
+
+		len = LZ4_MIN_MATCH;
+		while (ip + len < n - LZ4_LAST_LITS && src[ref + len] == src[ip + len]) {
+			len++;
+		}
+
+		op = lz4_sequence(op, src + anchor, ip - anchor, ip - ref, len);
+		ip += len;
+		anchor = ip;
+	}
+
+	op = lz4_sequence(op, src + anchor, n - anchor, 0, 0);
+	return op - dst;
+}
+
+static unsigned char *read_file(const char *path, size_t *size)
 {
-	int fdin1, fdin2, fdout;
+	unsigned char *buf;
+	ssize_t n;
+	int fd;
+
+	fd = safe_open(path, O_RDONLY);
+	*size = safe_getsize(fd);
+	buf = malloc(*size ? *size : 1);
+	if (!buf) {
+		fprintf(stderr, "install: %s: out of memory\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t done = 0; done < *size; done += n) {
+		n = safe_read(fd, buf + done, *size - done);
+		if (!n) {
+			*size = done;
+			break;
+		}
+	}
+
+	close(fd);
+	return buf;
+}
+
+/* boot/unlz4.bin + lz4 block: unpacked at the load base by the stub */
+static unsigned char *lz4_image(unsigned char *raw, off_t raw_size, off_t *size,
+	off_t *mem_size)
+{
+	struct unlz4_header uh;
+	unsigned char *img, *stub;
+	size_t stub_size, comp_size;
+	char *stubpath = "boot/unlz4.bin";
+
+	assert_not_dir(stubpath);
+	stub = read_file(stubpath, &stub_size);
+	if (stub_size < PAYLOAD_HEADER_OFFSET + sizeof(uh)) {
+		fprintf(stderr, "install: %s: not an lz4 stub\n", stubpath);
+		exit(EXIT_FAILURE);
+	}
+
+	memcpy(&uh, stub + PAYLOAD_HEADER_OFFSET, sizeof(uh));
+	if (uh.magic != UNLZ4_MAGIC) {
+		fprintf(stderr, "install: %s: not an lz4 stub\n", stubpath);
+		exit(EXIT_FAILURE);
+	}
+
+	img = malloc(stub_size + lz4_bound(raw_size));
+	if (!img) {
+		fprintf(stderr, "install: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	comp_size = lz4_compress(raw, raw_size, img + stub_size);
+
+	/* stub and block move above the payload's memory before unpacking */
+	uh.stub_size = stub_size;
+	uh.comp_size = comp_size;
+	uh.raw_size = raw_size;
+	uh.move_to = ((*mem_size > raw_size ? *mem_size : raw_size) + 15) & ~15;
+	memcpy(img, stub, stub_size);
+	memcpy(img + PAYLOAD_HEADER_OFFSET, &uh, sizeof(uh));
+
+	*size = stub_size + comp_size;
+	*mem_size = uh.move_to + *size;
+	free(stub);
+	return img;
+}
+
+/* file part of the payload (lz4 packed or raw), its load_info without index */
+static unsigned char *payload_image(const char *payload, int lz4, off_t *size,
+	struct load_info *info)
+{
+	unsigned char *image;
+	off_t payload_size, mem_size, raw_size;
+	size_t file_size;
+	struct payload_header hdr;
+
+	image = read_file(payload, &file_size);
+	payload_size = file_size;
+	mem_size = payload_size;
+
+	/* image header: only the file part goes to disk, the bss is zeroed */
+	if (file_size >= PAYLOAD_HEADER_OFFSET + sizeof(hdr)) {
+		memcpy(&hdr, image + PAYLOAD_HEADER_OFFSET, sizeof(hdr));
+		if (hdr.magic == PAYLOAD_MAGIC && hdr.file_size <= payload_size) {
+			payload_size = hdr.file_size;
+			mem_size = hdr.mem_size;
+		}
+	}
+
+	raw_size = payload_size;
+	if (lz4) {
+		unsigned char *packed = lz4_image(image, raw_size, &payload_size, &mem_size);
+
+		free(image);
+		image = packed;
+	}
+
+	/* too big for conventional memory: loaded at PAYLOAD_HIGH_BASE */
+	if (mem_size > PAYLOAD_HIGH_MAX - PAYLOAD_HIGH_BASE) {
+		fprintf(stderr, "%s: %lld bytes in memory, %d max\n", payload,
+			(long long) mem_size, PAYLOAD_HIGH_MAX - PAYLOAD_HIGH_BASE);
+		exit(EXIT_FAILURE);
+	}
+
+	memset(info, 0, sizeof(*info));
+	info->kbalign = 4;
+	info->kbsize = (mem_size + 1023) / 1024;
+	info->sectors = (payload_size + 511) / 512;
+	info->flags = lz4 ? LOAD_INFO_F_LZ4 : 0;
+	if (info->kbsize + info->kbalign > PAYLOAD_LOW_MAX_KB) {
+		info->flags |= LOAD_INFO_F_HIGH;
+		info->kbsize = 0;
+	}
+	printf("%s: %lld bytes on disk (%lld raw%s), %lld in memory, %s\n", payload,
+		(long long) payload_size, (long long) raw_size, lz4 ? ", lz4" : "",
+		(long long) mem_size, (info->flags & LOAD_INFO_F_HIGH) ? "high" : "low");
+
+	*size = payload_size;
+	return image;
+}
+
+/* several payloads: the chain loader boots, the directory and payloads follow */
+static off_t install_chain(int fdout, off_t lba, char **payloads, int npayloads,
+	int lz4, int run_all)
+{
+	struct chain_dir dir;
+	struct chain_entry *e;
+	unsigned char *image;
+	const char *name;
+	off_t size, dir_lba = lba;
+
+	if (npayloads > CHAIN_MAX) {
+		fprintf(stderr, "install: %d payloads, %d max\n", npayloads, CHAIN_MAX);
+		exit(EXIT_FAILURE);
+	}
+
+	memset(&dir, 0, sizeof(dir));
+	dir.magic = CHAIN_MAGIC;
+	dir.version = CHAIN_VERSION;
+	dir.count = npayloads;
+	dir.flags = run_all ? CHAIN_F_RUN_ALL : 0;
+	dir.state = CHAIN_S_IDLE;
+	lba += CHAIN_DIR_SECTORS;
+
+	for (int i = 0; i < npayloads; i++) {
+		e = &dir.entry[i];
+		image = payload_image(payloads[i], lz4, &size, &e->info);
+		e->info.index = lba;
+
+		name = strrchr(payloads[i], '/');
+		name = name ? name + 1 : payloads[i];
+		strncpy(e->name, name, sizeof(e->name) - 1);
+
+		safe_lseek(fdout, lba * 512, SEEK_SET);
+		safe_write(fdout, image, size);
+		free(image);
+		lba += e->info.sectors;
+	}
+
+	safe_lseek(fdout, dir_lba * 512, SEEK_SET);
+	safe_write(fdout, &dir, sizeof(dir));
+	return lba;
+}
+
+void install_legacy_boot(const char *device, char **payloads, int npayloads,
+	int lz4, int run_all)
+{
+	int fdin1, fdout;
 	ssize_t blksize;
-	unsigned char blkchar[512];
-	off_t part_size, payload_size;
+	unsigned char blkchar[512], *image;
+	off_t part_size, payload_size, results_lba = 0, lba;
 	struct load_info info;
 	struct partentry part;
 	char *firstsec = "boot/boot.bin";
+	char *chain = "payload/chain";
 
 	/* basic checks */
 	assert_not_dir(firstsec);
@@ -115,12 +378,19 @@ void install_legacy_boot(const char *device, const char *payload)
 
 	/* open */
 	fdin1 = safe_open(firstsec, O_RDONLY);
-	fdin2 = safe_open(payload, O_RDONLY);
 	fdout = safe_open(device, O_RDWR);
 
 	/* get sizes */
 	part_size = safe_getsize(fdout) - 512;
-	payload_size = safe_getsize(fdin2);
+
+	/* the mbr loads the payload, or the chain loader for several (raw) */
+	if (npayloads > 1) {
+		assert_not_dir(chain);
+		assert_rw_access(chain);
+		image = payload_image(chain, 0, &payload_size, &info);
+	} else {
+		image = payload_image(payloads[0], lz4, &payload_size, &info);
+	}
 
 	/* write mbr */
 	blksize = safe_read(fdin1, blkchar, sizeof(blkchar));
@@ -131,23 +401,27 @@ void install_legacy_boot(const char *device, const char *payload)
 
 	/* write payload, from second sector */
 	safe_lseek(fdout, 512, SEEK_SET);
-	blksize = safe_read(fdin2, blkchar, sizeof(blkchar));
-	while (blksize) {
-		safe_write(fdout, blkchar, blksize);
-		blksize = safe_read(fdin2, blkchar, sizeof(blkchar));
-	}
+	safe_write(fdout, image, payload_size);
+	free(image);
 
 	/* set payload info */
 	info.index = 1;
-	info.kbalign = 4;
-	info.kbsize = payload_size / 1024;
-	if (payload_size % 1024) {
-		info.kbsize += 1;
-	}
-
 	safe_lseek(fdout, MBR_LOAD_INFO_OFFSET, SEEK_SET);
 	safe_write(fdout, &info, sizeof(info));
 
+	lba = 1 + info.sectors;
+	if (npayloads > 1) {
+		lba = install_chain(fdout, lba, payloads, npayloads, lz4, run_all);
+	}
+	payload_size = (lba - 1) * 512;
+
+	/* results region at the end of the disk, when payload and region fit */
+	if (part_size / 512 >= (payload_size + 511) / 512 + RESULTS_SECTORS
+		&& part_size / 512 < 0xffffffff) {
+		results_lba = part_size / 512 + 1 - RESULTS_SECTORS;
+		part_size = (results_lba - 1) * 512;
+	}
+
 	/* set one partition entry (max 256MiB) */
 	if (part_size > 0x10000000) {
 		part_size = 0x10000000;
@@ -157,39 +431,166 @@ void install_legacy_boot(const char *device, const char *payload)
 	part.type = 0x83;
 	part.start_index = 1;
 	part.numof_sectors = part_size / 512;
-	lba2chs(part.start_index, &part.start_head);
-	lba2chs(part.start_index + part.numof_sectors - 1, &part.end_head);
+	lba2chs(part.start_index, part.start_chs);
+	lba2chs(part.start_index + part.numof_sectors - 1, part.end_chs);
 	safe_lseek(fdout, MBR_PART_TABLE_OFFSET, SEEK_SET);
 	safe_write(fdout, &part, sizeof(part));
 
+	/* second entry, the payload finds the region by its type */
+	if (results_lba) {
+		part.type = RESULTS_PART_TYPE;
+		part.start_index = results_lba;
+		part.numof_sectors = RESULTS_SECTORS;
+		lba2chs(part.start_index, part.start_chs);
+		lba2chs(part.start_index + part.numof_sectors - 1, part.end_chs);
+		safe_write(fdout, &part, sizeof(part));
+
+		/* no stale header from an earlier install */
+		memset(blkchar, 0, sizeof(blkchar));
+		safe_lseek(fdout, results_lba * 512, SEEK_SET);
+		safe_write(fdout, blkchar, sizeof(blkchar));
+	} else {
+		fprintf(stderr, "install: %s: no room for the results region\n", device);
+	}
+
 	close(fdin1);
-	close(fdin2);
 	close(fdout);
 }
 
-void install(const char *payload, const char *device)
+void install(char **payloads, int npayloads, const char *device, int lz4, int run_all)
 {
 	/* sanity check */
-	if (!payload || !device) {
-		fprintf(stderr, "bug: install: payload=%p, device=%p\n",
-			(void *) payload, (void *) device);
+	if (!npayloads || !device) {
+		fprintf(stderr, "bug: install: npayloads=%d, device=%p\n",
+			npayloads, (void *) device);
 		exit(EXIT_FAILURE);
 	}
 
 	/* basic checks */
-	assert_not_dir(payload);
+	for (int i = 0; i < npayloads; i++) {
+		assert_not_dir(payloads[i]);
+		assert_rw_access(payloads[i]);
+	}
 	assert_not_dir(device);
-	assert_rw_access(payload);
 	assert_rw_access(device);
 
 	/* install */
-	install_legacy_boot(device, payload);
+	install_legacy_boot(device, payloads, npayloads, lz4, run_all);
+}
+
+/* fd and rec (may be NULL) are released */
+static int dump_error(const char *device, const char *msg, int fd, void *rec)
+{
+	fprintf(stderr, "dump: %s: %s\n", device, msg);
+	free(rec);
+	close(fd);
+	return EXIT_FAILURE;
+}
+
+/* key=value lines, one per record, like the payload's bench output */
+int dump_results(const char *device)
+{
+	struct results_header hdr;
+	struct results_record *rec = NULL;
+	struct mbr mbr;
+	unsigned int crc, i, j;
+	off_t lba = 0;
+	size_t size;
+	int fd;
+
+	assert_not_dir(device);
+	fd = safe_open(device, O_RDONLY);
+
+	if (safe_read(fd, &mbr, sizeof(mbr)) != sizeof(mbr)) {
+		return dump_error(device, "short read", fd, rec);
+	}
+
+	for (i = 0; i < 4; i++) {
+		if (mbr.part_table[i].type == RESULTS_PART_TYPE) {
+			lba = mbr.part_table[i].start_index;
+			break;
+		}
+	}
+
+	if (!lba) {
+		return dump_error(device, "no results partition", fd, rec);
+	}
+
+	safe_lseek(fd, lba * 512, SEEK_SET);
+	if (safe_read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+		return dump_error(device, "short read", fd, rec);
+	}
+
+	if (hdr.magic != RESULTS_MAGIC) {
+		return dump_error(device, "no results written", fd, rec);
+	}
+
+	crc = hdr.header_crc;
+	hdr.header_crc = 0;
+	if (results_crc32(&hdr, sizeof(hdr)) != crc) {
+		return dump_error(device, "header crc mismatch", fd, rec);
+	}
+
+	if (hdr.version != RESULTS_VERSION || hdr.header_size != sizeof(hdr)
+		|| hdr.record_size != sizeof(*rec)
+		|| (off_t) hdr.nrecords * sizeof(*rec) > RESULTS_SECTORS * 512 - sizeof(hdr)) {
+		return dump_error(device, "unsupported results layout", fd, rec);
+	}
+
+	size = (size_t) hdr.nrecords * sizeof(*rec);
+	rec = malloc(size ? size : 1);
+	if (!rec) {
+		return dump_error(device, "out of memory", fd, rec);
+	}
+
+	if ((size_t) safe_read(fd, rec, size) != size) {
+		return dump_error(device, "short read", fd, rec);
+	}
+
+	if (results_crc32(rec, size) != hdr.data_crc) {
+		return dump_error(device, "data crc mismatch", fd, rec);
+	}
+
+	hdr.payload[sizeof(hdr.payload) - 1] = 0;
+	printf("results: payload=%s records=%u tsc_khz=%u tsc=%llu\n", hdr.payload,
+		hdr.nrecords, hdr.tsc_khz, hdr.tsc);
+
+	for (i = 0; i < hdr.nrecords; i++) {
+		rec[i].name[sizeof(rec[i].name) - 1] = 0;
+		if (rec[i].type == RESULTS_T_BENCH && rec[i].count == 7) {
+			printf("bench: name=%s cpu=%u iters=%llu reps=%llu", rec[i].name,
+				rec[i].cpu, rec[i].value[0], rec[i].value[1]);
+			printf(" min=%llu.%02llu median=%llu.%02llu p99=%llu.%02llu"
+				" mean=%llu.%02llu stddev=%llu.%02llu\n",
+				rec[i].value[2] / 100, rec[i].value[2] % 100,
+				rec[i].value[3] / 100, rec[i].value[3] % 100,
+				rec[i].value[4] / 100, rec[i].value[4] % 100,
+				rec[i].value[5] / 100, rec[i].value[5] % 100,
+				rec[i].value[6] / 100, rec[i].value[6] % 100);
+			continue;
+		}
+
+		if (rec[i].type == RESULTS_T_PAYLOAD) {
+			printf("payload: name=%s\n", rec[i].name);
+			continue;
+		}
+
+		printf("value: name=%s cpu=%u type=%u", rec[i].name, rec[i].cpu, rec[i].type);
+		for (j = 0; j < rec[i].count && j < RESULTS_VALUES; j++) {
+			printf(" v%u=%llu", j, rec[i].value[j]);
+		}
+		printf("\n");
+	}
+
+	free(rec);
+	close(fd);
+	return EXIT_SUCCESS;
 }
 
 int main(int argc, char *argv[])
 {
-	int ch = 0;
-	char *device = NULL, *payload = NULL;
+	int ch = 0, dump = 0, lz4 = 0, run_all = 0, npayloads = 0;
+	char *device = NULL, **payloads;
 
 	enum {
 		OPTION_HELP = CHAR_MAX + 1,
@@ -199,18 +600,40 @@ int main(int argc, char *argv[])
 	struct option longopts[] = {
 		{ "help"    ,  no_argument       , NULL, 'h' },
 		{ "payload" ,  required_argument , NULL, 'p' },
+		{ "dump-results", no_argument    , NULL, 'd' },
+		{ "lz4"     ,  no_argument       , NULL, 'z' },
+		{ "run-all" ,  no_argument       , NULL, 'a' },
 		{ NULL      ,  0                 , NULL,  0  }
 	};
 
+	/* each -p takes an argument, argc bounds them */
+	payloads = calloc(argc, sizeof(*payloads));
+	if (!payloads) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
 	/* parse args */
-	while ((ch = getopt_long(argc, argv, "hp:", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "hp:dza", longopts, NULL)) != -1) {
 		switch (ch) {
 			case 'h':
 				usage();
 				exit(EXIT_FAILURE);
 
 			case 'p':
-				payload = optarg;
+				payloads[npayloads++] = optarg;
+				break;
+
+			case 'd':
+				dump = 1;
+				break;
+
+			case 'z':
+				lz4 = 1;
+				break;
+
+			case 'a':
+				run_all = 1;
 				break;
 
 			default:
@@ -228,12 +651,17 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	if (!payload) {
+	if (dump) {
+		return dump_results(*argv);
+	}
+
+	if (!npayloads) {
 		fprintf(stderr, "payload isn't specified.\n");
 		exit(EXIT_FAILURE);
 	}
 
 	device = *argv;
-	install(payload, device);
+	install(payloads, npayloads, device, lz4, run_all);
+	free(payloads);
 	return EXIT_SUCCESS;
 }
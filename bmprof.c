@@ -0,0 +1,357 @@
+/*
+ * bmprof.c - symbolize a payload profile dump
+ */
+
+#include "profbuf.h"
+#include <elf.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+
+#define PROGRAM_NAME "bmprof"
+
+struct symbol {
+	unsigned int addr;
+	unsigned int size;
+	unsigned int end;       /* end of its section */
+	int func;
+	const char *name;
+};
+
+struct bucket {
+	unsigned int addr;      /* symbol or eip (-a) */
+	unsigned int count;
+	const struct symbol *sym;
+};
+
+void usage()
+{
+	fprintf(stderr, "Usage: %s [option] -e payload.elf dumpfile\n", PROGRAM_NAME);
+	fprintf(stderr, "  -e, --elf        unstripped payload (payload/something.elf)\n");
+	fprintf(stderr, "  -a, --address    histogram by address, not by function\n");
+	fprintf(stderr, "  -c, --csv        csv output (samples,percent,symbol)\n");
+	fprintf(stderr, "  -h, --help       give this help list\n");
+}
+
+static void *load_file(const char *path, size_t *size)
+{
+	FILE *fp;
+	char *buf;
+	long n;
+
+	fp = fopen(path, "rb");
+	if (!fp) {
+		fprintf(stderr, "open: %s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	fseek(fp, 0, SEEK_END);
+	n = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	buf = malloc(n + 1);
+	if (!buf || fread(buf, 1, n, fp) != (size_t) n) {
+		fprintf(stderr, "read: %s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	buf[n] = '\0';
+	*size = n;
+	fclose(fp);
+	return buf;
+}
+
+static int symbol_cmp(const void *a, const void *b)
+{
+	const struct symbol *s1 = a, *s2 = b;
+
+	if (s1->addr != s2->addr) {
+		return (s1->addr < s2->addr) ? -1 : 1;
+	}
+
+	/* functions before labels at the same address */
+	return s2->func - s1->func;
+}
+
+/* code symbols of an elf32 image, sorted by address */
+static struct symbol *load_symbols(const char *elf, size_t elfsize,
+	size_t *nsyms, unsigned int *payload_start)
+{
+	const Elf32_Ehdr *eh = (const Elf32_Ehdr *) elf;
+	const Elf32_Shdr *sh, *symtab = NULL, *strtab;
+	const Elf32_Sym *sym;
+	struct symbol *syms;
+	size_t n = 0, count;
+
+	if (elfsize < sizeof(*eh) || memcmp(eh->e_ident, ELFMAG, SELFMAG) ||
+		eh->e_ident[EI_CLASS] != ELFCLASS32 ||
+		(size_t) eh->e_shoff + eh->e_shnum * sizeof(*sh) > elfsize) {
+		return NULL;
+	}
+
+	sh = (const Elf32_Shdr *) (elf + eh->e_shoff);
+	for (int i = 0; i < eh->e_shnum; i++) {
+		if (sh[i].sh_type == SHT_SYMTAB) {
+			symtab = &sh[i];
+		}
+	}
+
+	if (!symtab || symtab->sh_link >= eh->e_shnum) {
+		return NULL;
+	}
+
+	strtab = &sh[symtab->sh_link];
+	count = symtab->sh_size / sizeof(*sym);
+	sym = (const Elf32_Sym *) (elf + symtab->sh_offset);
+
+	syms = calloc(count, sizeof(*syms));
+	if (!syms) {
+		fprintf(stderr, "%s: out of memory\n", PROGRAM_NAME);
+		exit(EXIT_FAILURE);
+	}
+
+	*payload_start = 0;
+	for (size_t i = 0; i < count; i++) {
+		const char *name = elf + strtab->sh_offset + sym[i].st_name;
+		int type = ELF32_ST_TYPE(sym[i].st_info);
+
+		if (!strcmp(name, "__payload_start")) {
+			*payload_start = sym[i].st_value;
+			continue;
+		}
+
+		/* .L: local labels the assembler kept (jump tables) */
+		if (!*name || !strncmp(name, ".L", 2) || sym[i].st_shndx == SHN_UNDEF ||
+			sym[i].st_shndx >= SHN_LORESERVE || !(sh[sym[i].st_shndx].sh_flags & SHF_EXECINSTR) ||
+			(type != STT_FUNC && type != STT_NOTYPE)) {
+			continue;
+		}
+
+		syms[n].addr = sym[i].st_value;
+		syms[n].size = sym[i].st_size;
+		syms[n].end = sh[sym[i].st_shndx].sh_addr + sh[sym[i].st_shndx].sh_size;
+		syms[n].func = (type == STT_FUNC);
+		syms[n].name = name;
+		n++;
+	}
+
+	qsort(syms, n, sizeof(*syms), symbol_cmp);
+	*nsyms = n;
+	return syms;
+}
+
+/* last symbol at or below addr, NULL past a sized function or its section */
+static const struct symbol *lookup(const struct symbol *syms, size_t n,
+	unsigned int addr)
+{
+	size_t lo = 0, hi = n;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (syms[mid].addr <= addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (!lo) {
+		return NULL;
+	}
+
+	/* first of the symbols at that address (function preferred) */
+	while (lo > 1 && syms[lo - 2].addr == syms[lo - 1].addr) {
+		lo--;
+	}
+
+	if (addr >= syms[lo - 1].end ||
+		(syms[lo - 1].size && addr >= syms[lo - 1].addr + syms[lo - 1].size)) {
+		return NULL;
+	}
+
+	return &syms[lo - 1];
+}
+
+static int bucket_cmp(const void *a, const void *b)
+{
+	const struct bucket *b1 = a, *b2 = b;
+
+	if (b1->count != b2->count) {
+		return (b1->count > b2->count) ? -1 : 1;
+	}
+
+	return (b1->addr < b2->addr) ? -1 : (b1->addr > b2->addr);
+}
+
+static int bucket_addr_cmp(const void *a, const void *b)
+{
+	const struct bucket *b1 = a, *b2 = b;
+	return (b1->addr < b2->addr) ? -1 : (b1->addr > b2->addr);
+}
+
+void report(const char *elffile, const char *dumpfile, int byaddr, int csv)
+{
+	size_t elfsize, dumpsize, nsyms, nsamples = 0, nbuckets = 0;
+	const struct prof_header *hdr;
+	const struct prof_ring *ring;
+	const struct symbol *sym;
+	struct bucket *samples;
+	struct symbol *syms;
+	unsigned int payload_start, count, dropped = 0, other = 0;
+	char *elf, *dump, name[256];
+
+	elf = load_file(elffile, &elfsize);
+	dump = load_file(dumpfile, &dumpsize);
+	hdr = (const struct prof_header *) dump;
+
+	/* sanity checks */
+	if (dumpsize < sizeof(*hdr) || hdr->magic != PROF_MAGIC ||
+		hdr->version != PROF_VERSION || hdr->ring_size != PROF_RING_SIZE) {
+		fprintf(stderr, "%s: %s: not a profile dump\n", PROGRAM_NAME, dumpfile);
+		exit(EXIT_FAILURE);
+	}
+
+	if (dumpsize < sizeof(*hdr) + hdr->ncpu * sizeof(*ring)) {
+		fprintf(stderr, "%s: %s: truncated dump\n", PROGRAM_NAME, dumpfile);
+		exit(EXIT_FAILURE);
+	}
+
+	syms = load_symbols(elf, elfsize, &nsyms, &payload_start);
+	if (!syms) {
+		fprintf(stderr, "%s: %s: no elf32 symbol table (stripped?)\n",
+			PROGRAM_NAME, elffile);
+		exit(EXIT_FAILURE);
+	}
+
+	samples = calloc(hdr->ncpu * (size_t) PROF_RING_SIZE, sizeof(*samples));
+	if (!samples) {
+		fprintf(stderr, "%s: out of memory\n", PROGRAM_NAME);
+		exit(EXIT_FAILURE);
+	}
+
+	/* runtime eip to link address: the image isn't relocated, only moved */
+	ring = (const struct prof_ring *) (hdr + 1);
+	for (unsigned int i = 0; i < hdr->ncpu; i++, ring++) {
+		if (ring->magic != PROF_MAGIC) {
+			continue;
+		}
+
+		count = (ring->head < PROF_RING_SIZE) ? ring->head : PROF_RING_SIZE;
+		dropped += ring->head - count;
+		other += ring->other;
+
+		for (unsigned int j = 0; j < count; j++) {
+			unsigned int addr = ring->eip[j] - hdr->text_base + payload_start;
+
+			sym = lookup(syms, nsyms, addr);
+			samples[nsamples].addr = (byaddr || !sym) ? addr : sym->addr;
+			samples[nsamples].sym = sym;
+			samples[nsamples].count = 1;
+			nsamples++;
+		}
+	}
+
+	/* fold equal addresses */
+	qsort(samples, nsamples, sizeof(*samples), bucket_addr_cmp);
+	for (size_t i = 0; i < nsamples; i++) {
+		if (nbuckets && samples[nbuckets - 1].addr == samples[i].addr) {
+			samples[nbuckets - 1].count++;
+		} else {
+			samples[nbuckets++] = samples[i];
+		}
+	}
+
+	qsort(samples, nbuckets, sizeof(*samples), bucket_cmp);
+
+	if (csv) {
+		printf("samples,percent,symbol\n");
+	} else {
+		printf("%zu samples, every %u cycles, %u dropped, %u other nmis\n",
+			nsamples, hdr->period, dropped, other);
+	}
+
+	for (size_t i = 0; i < nbuckets; i++) {
+		sym = samples[i].sym;
+
+		if (!sym) {
+			snprintf(name, sizeof(name), "0x%x", samples[i].addr);
+		} else if (byaddr) {
+			snprintf(name, sizeof(name), "%s+0x%x", sym->name,
+				samples[i].addr - sym->addr);
+		} else {
+			snprintf(name, sizeof(name), "%s", sym->name);
+		}
+
+		if (csv) {
+			printf("%u,%.2f,\"%s\"\n", samples[i].count,
+				100.0 * samples[i].count / nsamples, name);
+		} else {
+			printf("%8u %6.2f%%  %s\n", samples[i].count,
+				100.0 * samples[i].count / nsamples, name);
+		}
+	}
+
+	free(samples);
+	free(syms);
+	free(dump);
+	free(elf);
+}
+
+int main(int argc, char *argv[])
+{
+	int ch = 0, csv = 0, byaddr = 0;
+	char *elffile = NULL;
+
+	struct option longopts[] = {
+		{ "help"    ,  no_argument       , NULL, 'h' },
+		{ "address" ,  no_argument       , NULL, 'a' },
+		{ "csv"     ,  no_argument       , NULL, 'c' },
+		{ "elf"     ,  required_argument , NULL, 'e' },
+		{ NULL      ,  0                 , NULL,  0  }
+	};
+
+	/* parse args */
+	while ((ch = getopt_long(argc, argv, "hace:", longopts, NULL)) != -1) {
+		switch (ch) {
+			case 'h':
+				usage();
+				exit(EXIT_FAILURE);
+
+			case 'a':
+				byaddr = 1;
+				break;
+
+			case 'c':
+				csv = 1;
+				break;
+
+			case 'e':
+				elffile = optarg;
+				break;
+
+			default:
+				fprintf(stderr, "Try '%s --help for more information.\n",
+					PROGRAM_NAME);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (!argc) {
+		fprintf(stderr, "dump file isn't specified.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (!elffile) {
+		fprintf(stderr, "payload elf isn't specified.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	report(elffile, *argv, byaddr, csv);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,320 @@
+/*
+ * bmtrace.c - decode a payload trace dump
+ */
+
+#include "tracebuf.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <limits.h>
+
+
+#define PROGRAM_NAME "bmtrace"
+
+struct event {
+	struct trace_record rec;
+	unsigned int seq;
+};
+
+void usage()
+{
+	fprintf(stderr, "Usage: %s [option] -p payload dumpfile\n", PROGRAM_NAME);
+	fprintf(stderr, "  -p, --payload    payload the dump was taken from\n");
+	fprintf(stderr, "  -c, --csv        csv output (cpu,tsc,id,message)\n");
+	fprintf(stderr, "  -h, --help       give this help list\n");
+}
+
+static void *load_file(const char *path, size_t *size)
+{
+	FILE *fp;
+	char *buf;
+	long n;
+
+	fp = fopen(path, "rb");
+	if (!fp) {
+		fprintf(stderr, "open: %s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	fseek(fp, 0, SEEK_END);
+	n = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	buf = malloc(n + 1);
+	if (!buf || fread(buf, 1, n, fp) != (size_t) n) {
+		fprintf(stderr, "read: %s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	buf[n] = '\0';
+	*size = n;
+	fclose(fp);
+	return buf;
+}
+
+/* format one record, 64-bit conversions take two args (low, high) */
+static void format_record(char *out, size_t outsz, const char *fmt,
+	const struct trace_record *rec)
+{
+	char spec[32], tmp[128];
+	unsigned int argi = 0;
+	unsigned long long v;
+	size_t len = 0;
+	int lcount;
+
+	out[0] = '\0';
+
+	while (*fmt && len + 1 < outsz) {
+		const char *start = fmt;
+		size_t speclen;
+
+		if (*fmt != '%') {
+			out[len++] = *fmt++;
+			out[len] = '\0';
+			continue;
+		}
+
+		/* %[flags][width][.precision][length]conv */
+		fmt++;
+		fmt += strspn(fmt, "-+ #0");
+		fmt += strspn(fmt, "0123456789");
+		if (*fmt == '.') {
+			fmt++;
+			fmt += strspn(fmt, "0123456789");
+		}
+
+		lcount = 0;
+		while (*fmt == 'l' || *fmt == 'h') {
+			lcount += (*fmt == 'l');
+			fmt++;
+		}
+
+		if (!*fmt) {
+			break;
+		}
+
+		/* rebuild the spec without length modifiers */
+		speclen = fmt - start;
+		if (speclen >= sizeof(spec) - 4) {
+			speclen = sizeof(spec) - 4;
+		}
+
+		memcpy(spec, start, speclen);
+		while (speclen && (spec[speclen - 1] == 'l' || spec[speclen - 1] == 'h')) {
+			speclen--;
+		}
+		spec[speclen] = '\0';
+
+		if (*fmt == '%') {
+			snprintf(tmp, sizeof(tmp), "%%");
+			goto _append;
+		}
+
+		if (argi >= rec->nargs) {
+			snprintf(tmp, sizeof(tmp), "?");
+			goto _append;
+		}
+
+		v = rec->args[argi++];
+		if (lcount == 2) {
+			v |= (argi < rec->nargs) ?
+				(unsigned long long) rec->args[argi++] << 32 : 0;
+		}
+
+		switch (*fmt) {
+			case 'd':
+			case 'i':
+				snprintf(spec + speclen, sizeof(spec) - speclen, "lld");
+				snprintf(tmp, sizeof(tmp), spec,
+					(lcount == 2) ? (long long) v : (long long) (int) v);
+				break;
+
+			case 'u':
+			case 'x':
+			case 'X':
+			case 'o':
+				snprintf(spec + speclen, sizeof(spec) - speclen, "ll%c", *fmt);
+				snprintf(tmp, sizeof(tmp), spec, v);
+				break;
+
+			case 'c':
+				snprintf(spec + speclen, sizeof(spec) - speclen, "c");
+				snprintf(tmp, sizeof(tmp), spec, (int) v);
+				break;
+
+			case 'p':
+				snprintf(tmp, sizeof(tmp), "0x%llx", v);
+				break;
+
+			default:
+				/* strings aren't recorded, only their address */
+				snprintf(tmp, sizeof(tmp), "<%c:0x%llx>", *fmt, v);
+		}
+
+_append:
+		fmt++;
+		len += snprintf(out + len, outsz - len, "%s", tmp);
+		if (len >= outsz) {
+			len = outsz - 1;
+		}
+	}
+}
+
+static void print_csv_field(const char *s)
+{
+	putchar('"');
+	for (; *s; s++) {
+		if (*s == '"') {
+			putchar('"');
+		}
+		putchar(*s);
+	}
+	putchar('"');
+}
+
+static int event_cmp(const void *a, const void *b)
+{
+	const struct event *e1 = a, *e2 = b;
+
+	if (e1->rec.tsc != e2->rec.tsc) {
+		return (e1->rec.tsc < e2->rec.tsc) ? -1 : 1;
+	}
+
+	return (e1->seq < e2->seq) ? -1 : (e1->seq > e2->seq);
+}
+
+void decode(const char *payload, const char *dumpfile, int csv)
+{
+	size_t imgsize, dumpsize, nevents = 0;
+	const struct trace_header *hdr;
+	const struct trace_ring *ring;
+	struct event *events;
+	char *img, *dump, msg[512];
+	unsigned int count, first;
+
+	img = load_file(payload, &imgsize);
+	dump = load_file(dumpfile, &dumpsize);
+	hdr = (const struct trace_header *) dump;
+
+	/* sanity checks */
+	if (dumpsize < sizeof(*hdr) || hdr->magic != TRACE_MAGIC ||
+		hdr->version != TRACE_VERSION || hdr->ring_size != TRACE_RING_SIZE) {
+		fprintf(stderr, "%s: %s: not a trace dump\n", PROGRAM_NAME, dumpfile);
+		exit(EXIT_FAILURE);
+	}
+
+	if (dumpsize < sizeof(*hdr) + hdr->ncpu * sizeof(*ring)) {
+		fprintf(stderr, "%s: %s: truncated dump\n", PROGRAM_NAME, dumpfile);
+		exit(EXIT_FAILURE);
+	}
+
+	if ((size_t) hdr->fmt_offset + hdr->fmt_size > imgsize) {
+		fprintf(stderr, "%s: %s: payload doesn't match the dump\n",
+			PROGRAM_NAME, payload);
+		exit(EXIT_FAILURE);
+	}
+
+	events = calloc(hdr->ncpu * (size_t) TRACE_RING_SIZE, sizeof(*events));
+	if (!events) {
+		fprintf(stderr, "%s: out of memory\n", PROGRAM_NAME);
+		exit(EXIT_FAILURE);
+	}
+
+	/* collect the valid window of each ring, oldest first */
+	ring = (const struct trace_ring *) (hdr + 1);
+	for (unsigned int i = 0; i < hdr->ncpu; i++, ring++) {
+		if (ring->magic != TRACE_MAGIC) {
+			continue;
+		}
+
+		count = (ring->head < TRACE_RING_SIZE) ? ring->head : TRACE_RING_SIZE;
+		first = ring->head - count;
+
+		for (unsigned int j = 0; j < count; j++) {
+			events[nevents].rec = ring->rec[(first + j) & (TRACE_RING_SIZE - 1)];
+			events[nevents].seq = nevents;
+			nevents++;
+		}
+	}
+
+	qsort(events, nevents, sizeof(*events), event_cmp);
+
+	if (csv) {
+		printf("cpu,tsc,id,message\n");
+	}
+
+	for (size_t i = 0; i < nevents; i++) {
+		const struct trace_record *rec = &events[i].rec;
+
+		if (rec->id >= hdr->fmt_size || rec->nargs > TRACE_MAXARGS) {
+			snprintf(msg, sizeof(msg), "<bad record id=%u>", rec->id);
+		} else {
+			format_record(msg, sizeof(msg), img + hdr->fmt_offset + rec->id, rec);
+		}
+
+		if (csv) {
+			printf("%u,%llu,%u,", rec->cpu, rec->tsc, rec->id);
+			print_csv_field(msg);
+			putchar('\n');
+		} else {
+			printf("[%u] %20llu  %s\n", rec->cpu, rec->tsc, msg);
+		}
+	}
+
+	free(events);
+	free(dump);
+	free(img);
+}
+
+int main(int argc, char *argv[])
+{
+	int ch = 0, csv = 0;
+	char *payload = NULL;
+
+	struct option longopts[] = {
+		{ "help"    ,  no_argument       , NULL, 'h' },
+		{ "csv"     ,  no_argument       , NULL, 'c' },
+		{ "payload" ,  required_argument , NULL, 'p' },
+		{ NULL      ,  0                 , NULL,  0  }
+	};
+
+	/* parse args */
+	while ((ch = getopt_long(argc, argv, "hcp:", longopts, NULL)) != -1) {
+		switch (ch) {
+			case 'h':
+				usage();
+				exit(EXIT_FAILURE);
+
+			case 'c':
+				csv = 1;
+				break;
+
+			case 'p':
+				payload = optarg;
+				break;
+
+			default:
+				fprintf(stderr, "Try '%s --help for more information.\n",
+					PROGRAM_NAME);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (!argc) {
+		fprintf(stderr, "dump file isn't specified.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (!payload) {
+		fprintf(stderr, "payload isn't specified.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	decode(payload, *argv, csv);
+	return EXIT_SUCCESS;
+}
@@ -6,8 +6,9 @@
 #define BOOT_H
 
 #define BOOTSEG 0x7c0
-#define STARTUP32_OFFSET      424
-#define MBR_LOAD_INFO_OFFSET  432
+#define MBR_DRIVE_OFFSET      418 /* bios boot drive, set by boot.S */
+#define STARTUP32_OFFSET      420
+#define MBR_LOAD_INFO_OFFSET  428 /* up to the disk signature at 440 */
 #define MBR_PART_TABLE_OFFSET 446
 #define MBR_BOOT_SIGNATURE    510
 
@@ -16,21 +17,101 @@
 #define CODE32 0x10
 #define DATA16 0x18
 #define CODE16 0x20
+#define CODE64 0x28 /* long mode, payload/long.S */
+
+/* payload image header, payload/head.S */
+#define PAYLOAD_MAGIC         0x4c594150 /* "PAYL" */
+#define PAYLOAD_HEADER_OFFSET 8
+
+/* lz4 images: boot/unlz4.S in front of the compressed payload */
+#define UNLZ4_MAGIC           0x50345a4c /* "LZ4P" */
+#define LOAD_INFO_F_LZ4       0x01       /* load_info.flags */
+#define LOAD_INFO_F_HIGH      0x02       /* at PAYLOAD_HIGH_BASE, no bda reservation */
+#define LOAD_INFO_F_CHAIN     0x04       /* run by payload/chain, include/chaindir.h */
+
+/* images above PAYLOAD_LOW_MAX_KB go high, below the bench buffers at 16M */
+#define PAYLOAD_LOW_MAX_KB    448
+#define PAYLOAD_HIGH_BASE     0x400000
+#define PAYLOAD_HIGH_MAX      0xc00000
+
+/* boot.S reads through it, the ap trampoline is copied there later */
+#define BOOT_BOUNCE           0x8000
+#define BOOT_BOUNCE_SECTORS   64
+
+/*
+ * rdtsc at named boot stages, one struct boot_times per apic id, above the
+ * bios thunk stack and below the mbr stack. 0 is a stage not reached.
+ */
+#define BOOT_TIMES            0x7000
+#define BOOT_TIMES_CPUS       8
+#define BOOT_STAGES           16
+
+#define BOOT_STAGE_LOAD_START    0  /* boot.S, before the first sector (bsp) */
+#define BOOT_STAGE_LOAD_END      1
+#define BOOT_STAGE_UNPACK_START  2  /* boot/unlz4.S, lz4 images */
+#define BOOT_STAGE_UNPACK_END    3
+#define BOOT_STAGE_HEAD          4  /* payload/head.S, protected mode (bsp) */
+#define BOOT_STAGE_SIPI          5  /* apic_init_thread, stamped by the sender (aps) */
+#define BOOT_STAGE_CPU_INIT      6  /* x86_cpu_init */
+#define BOOT_STAGE_CPU_INIT_END  7
+#define BOOT_STAGE_APIC_INIT     8  /* apic_init */
+#define BOOT_STAGE_CALIBRATE     9  /* apic timer and tsc against hpet or pit */
+#define BOOT_STAGE_CALIBRATE_END 10
+#define BOOT_STAGE_APIC_INIT_END 11
+#define BOOT_STAGE_PAGES         12 /* init_early_pages */
+#define BOOT_STAGE_PAGES_END     13
+
+#define BOOT_TSC_LOAD_START   (BOOT_TIMES+8*BOOT_STAGE_LOAD_START)
+#define BOOT_TSC_LOAD_END     (BOOT_TIMES+8*BOOT_STAGE_LOAD_END)
+#define BOOT_TSC_UNPACK_START (BOOT_TIMES+8*BOOT_STAGE_UNPACK_START)
+#define BOOT_TSC_UNPACK_END   (BOOT_TIMES+8*BOOT_STAGE_UNPACK_END)
+#define BOOT_TSC_HEAD         (BOOT_TIMES+8*BOOT_STAGE_HEAD)
 
 #ifdef __ASSEMBLY__
 #define LOAD_INFO_U32_INDEX  MBR_LOAD_INFO_OFFSET+0
 #define LOAD_INFO_U16_KBSIZE MBR_LOAD_INFO_OFFSET+4
 #define LOAD_INFO_U8_KBALIGN MBR_LOAD_INFO_OFFSET+6
+#define LOAD_INFO_U8_FLAGS   MBR_LOAD_INFO_OFFSET+7
+#define LOAD_INFO_U32_SECTORS MBR_LOAD_INFO_OFFSET+8
 
 #define DEFINE_ASM_LOAD_INFO \
-.long 0; .short 0; .byte 0; .byte 0
+.long 0; .short 0; .byte 0; .byte 0; .long 0
+
+#define PAYLOAD_HDR_MAGIC     PAYLOAD_HEADER_OFFSET+0
+#define PAYLOAD_HDR_BSS_START PAYLOAD_HEADER_OFFSET+12
+#define PAYLOAD_HDR_BSS_END   PAYLOAD_HEADER_OFFSET+16
 
 #else /* !__ASSEMBLY__ */
 struct load_info {
 	unsigned int   index;   /* sector index */
-	unsigned short kbsize;  /* size in KBytes */
+	unsigned short kbsize;  /* memory size in KBytes, bss included (low) */
 	unsigned char  kbalign; /* alignment */
-	unsigned char  zero;
+	unsigned char  flags;   /* LOAD_INFO_F_* */
+	unsigned int   sectors; /* file size in sectors, what boot.S reads */
+} __attribute__((packed));
+
+/* at PAYLOAD_HEADER_OFFSET in the image, offsets from the image start */
+struct payload_header {
+	unsigned int magic;
+	unsigned int file_size; /* text and data, what bminstall writes */
+	unsigned int mem_size;  /* bss included */
+	unsigned int bss_start;
+	unsigned int bss_end;
+	unsigned int zero[3];
+} __attribute__((packed));
+
+/* at PAYLOAD_HEADER_OFFSET in boot/unlz4.bin, filled by bminstall */
+struct unlz4_header {
+	unsigned int magic;
+	unsigned int stub_size; /* compressed data follows the stub */
+	unsigned int comp_size;
+	unsigned int raw_size;
+	unsigned int move_to;   /* stub and data go there first, above the bss */
+	unsigned int zero[3];
+} __attribute__((packed));
+
+struct boot_times {
+	unsigned long long tsc[BOOT_STAGES]; /* BOOT_STAGE_* */
 } __attribute__((packed));
 #endif
 
@@ -0,0 +1,49 @@
+/*
+ * chaindir.h - payload directory of multi-payload disks (shared with bminstall)
+ *
+ * bminstall -p a -p b ...: payload/chain at lba 1 (the mbr's load_info),
+ * the directory right after it, then the payloads. the chain loader runs
+ * one, its bsp's payload_done() resets the machine and the loader picks
+ * the next from the state kept here.
+ */
+
+#ifndef CHAINDIR_H
+#define CHAINDIR_H
+
+#include "boot.h"
+
+#define CHAIN_MAGIC        0x4e484342 /* "BCHN" */
+#define CHAIN_VERSION      1
+#define CHAIN_DIR_SECTORS  4
+#define CHAIN_MAX          ((CHAIN_DIR_SECTORS * 512 - 32) / 32)
+
+/* chain_dir.flags */
+#define CHAIN_F_RUN_ALL    0x01 /* no menu on a fresh install, run every payload */
+
+/* chain_dir.state, written back before each payload runs */
+#define CHAIN_S_IDLE       0    /* fresh install: menu with a timeout, then run all */
+#define CHAIN_S_RUN_ALL    1    /* entry[next] runs next */
+#define CHAIN_S_DONE       2    /* menu, no timeout */
+
+#define CHAIN_MENU_SECONDS 5
+#define CHAIN_PAUSE_MS     2000 /* the screen is cleared by the reset */
+
+#ifndef __ASSEMBLY__
+struct chain_entry {
+	struct load_info info;   /* index is the payload's lba */
+	char             name[20];
+} __attribute__((packed));
+
+struct chain_dir {
+	unsigned int       magic;
+	unsigned int       version;
+	unsigned int       count;
+	unsigned int       flags;
+	unsigned int       state;
+	unsigned int       next;
+	unsigned int       zero[2];
+	struct chain_entry entry[CHAIN_MAX];
+} __attribute__((packed));
+#endif /* !__ASSEMBLY__ */
+
+#endif /* CHAINDIR_H */
@@ -24,6 +24,15 @@
 #define LABEL(n) n
 #endif
 
+/*
+ * x86-64 pie takes extern addresses from the got, which nothing fills in
+ * (the image isn't relocated). hidden keeps them pc-relative, the makefile
+ * includes this header first in 64-bit objects.
+ */
+#if defined (__x86_64__) && !defined (__ASSEMBLY__)
+#pragma GCC visibility push(hidden)
+#endif
+
 #define __STR(...) #__VA_ARGS__
 
 #define __USE_SECTION(name, flags) \
@@ -33,9 +42,14 @@
 	__USE_SECTION(__DATA_NAME__,__DATA_FLAGS__)
 
 #define __align(n) __attribute__((aligned(n)))
+/* linker script symbols, resolved pc-relative (no got entry) */
+#define __hidden __attribute__((visibility("hidden")))
 #define __trap() while(1)
 #define __halt() while (1) __asm__ volatile ("hlt")
 
 #define __interrupt __attribute__ ((interrupt))
 
+/* payload entry, placed first in the image by script.ld */
+#define __entry __attribute__((section(".text.entry"), noreturn))
+
 #endif /* COMPILER_H */
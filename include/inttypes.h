@@ -12,6 +12,7 @@ typedef signed int int32_t;
 typedef unsigned int uint32_t;
 typedef signed long long int64_t;
 typedef unsigned long long uint64_t;
+typedef unsigned long uintptr_t;
 #endif /* !__ASSEMBLY__ */
 
 #endif /* INTTYPES_H */
@@ -10,13 +10,9 @@
 #pragma pack(push, 1)
 struct partentry {
 	uint8_t  status;
-	uint8_t  start_head;
-	uint8_t  start_sector;
-	uint8_t  start_track;
+	uint8_t  start_chs[3]; /* head, sector, track (lba2chs) */
 	uint8_t  type;
-	uint8_t  end_head;
-	uint8_t  end_sector;
-	uint8_t  end_track;
+	uint8_t  end_chs[3];
 	uint32_t start_index;
 	uint32_t numof_sectors;
 };
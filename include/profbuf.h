@@ -0,0 +1,36 @@
+/*
+ * profbuf.h - sampling profiler area layout (shared with bmprof)
+ */
+
+#ifndef PROFBUF_H
+#define PROFBUF_H
+
+#define PROF_MAGIC     0x464f5250 /* "PROF" */
+#define PROF_VERSION   1
+
+/* fixed physical area, after the trace area, inside the early 4M mapping */
+#define PROF_AREA      0x300000
+#define PROF_RING_SIZE 16384      /* samples per cpu, sampling stops when full */
+
+#ifndef __ASSEMBLY__
+struct prof_ring {
+	unsigned int magic;
+	unsigned int cpu;
+	unsigned int head;          /* samples taken, may exceed the ring */
+	unsigned int other;         /* nmis not caused by the counter */
+	unsigned int zero[4];
+	unsigned int eip[PROF_RING_SIZE];
+} __attribute__((packed));
+
+struct prof_header {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int ncpu;
+	unsigned int ring_size;
+	unsigned int text_base;     /* runtime address of __payload_start */
+	unsigned int period;        /* core cycles per sample */
+	unsigned int zero[2];
+} __attribute__((packed));
+#endif /* !__ASSEMBLY__ */
+
+#endif /* PROFBUF_H */
@@ -0,0 +1,62 @@
+/*
+ * resultbuf.h - on-disk results region layout (shared with bminstall)
+ */
+
+#ifndef RESULTBUF_H
+#define RESULTBUF_H
+
+#define RESULTS_MAGIC     0x53524d42 /* "BMRS" */
+#define RESULTS_VERSION   1
+#define RESULTS_PART_TYPE 0xda       /* non-fs data, second mbr entry */
+#define RESULTS_SECTORS   2048       /* 1 MiB at the end of the disk */
+
+/* staging copy, written out by results_flush() */
+#define RESULTS_AREA      0x100000
+#define RESULTS_VALUES    8
+
+/* record types */
+#define RESULTS_T_VALUE   0          /* value[0..count) as given */
+#define RESULTS_T_BENCH   1          /* iters, reps, min, median, p99, mean, stddev */
+#define RESULTS_T_PAYLOAD 2          /* name only, a chained payload's records follow */
+
+#ifndef __ASSEMBLY__
+struct results_header {
+	unsigned int       magic;
+	unsigned int       version;
+	unsigned int       header_size;
+	unsigned int       record_size;
+	unsigned int       nrecords;
+	unsigned int       data_crc;     /* crc32 of the records */
+	unsigned int       header_crc;   /* crc32 of the header, this field 0 */
+	unsigned int       tsc_khz;
+	unsigned long long tsc;          /* at results_init() */
+	char               payload[16];
+	unsigned int       zero[2];
+} __attribute__((packed));
+
+struct results_record {
+	unsigned short     type;
+	unsigned short     cpu;
+	unsigned int       count;        /* valid entries in value */
+	char               name[32];
+	unsigned long long value[RESULTS_VALUES];
+} __attribute__((packed));
+
+/* crc32 (ieee), bitwise: small and the same on both ends */
+static inline unsigned int results_crc32(const void *buf, unsigned int len)
+{
+	const unsigned char *p = (const unsigned char *) buf;
+	unsigned int crc = 0xffffffff;
+
+	while (len--) {
+		crc ^= *p++;
+		for (int i = 0; i < 8; i++) {
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		}
+	}
+
+	return ~crc;
+}
+#endif /* !__ASSEMBLY__ */
+
+#endif /* RESULTBUF_H */
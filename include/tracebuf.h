@@ -0,0 +1,45 @@
+/*
+ * tracebuf.h - binary trace area layout (shared with bmtrace)
+ */
+
+#ifndef TRACEBUF_H
+#define TRACEBUF_H
+
+#define TRACE_MAGIC     0x43525442 /* "BTRC" */
+#define TRACE_VERSION   1
+
+/* fixed physical area, above the payload, inside the early 4M mapping */
+#define TRACE_AREA      0x200000
+#define TRACE_RING_SIZE 4096       /* records per cpu, power of two */
+#define TRACE_MAXARGS   5
+
+#ifndef __ASSEMBLY__
+struct trace_record {
+	unsigned long long tsc;
+	unsigned short     id;      /* offset in the format table */
+	unsigned char      nargs;   /* number of 32-bit args */
+	unsigned char      cpu;
+	unsigned int       args[TRACE_MAXARGS];
+} __attribute__((packed));
+
+struct trace_ring {
+	unsigned int magic;
+	unsigned int cpu;
+	unsigned int head;          /* records written, wraps the ring */
+	unsigned int size;
+	unsigned int zero[4];
+	struct trace_record rec[TRACE_RING_SIZE];
+} __attribute__((packed));
+
+struct trace_header {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int ncpu;
+	unsigned int ring_size;
+	unsigned int fmt_offset;    /* format table offset in payload image */
+	unsigned int fmt_size;
+	unsigned int zero[2];
+} __attribute__((packed));
+#endif /* !__ASSEMBLY__ */
+
+#endif /* TRACEBUF_H */
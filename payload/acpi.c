@@ -0,0 +1,405 @@
+/*
+ * acpi.c - rsdp scan, rsdt/xsdt walk, madt/srat/slit parsing
+ */
+
+#include "cpu.h"
+#include "acpi.h"
+#include "lapic.h"
+#include "string.h"
+#include "compiler.h"
+
+#define EBDA_SEG_PTR  0x40e     /* bda: ebda segment */
+#define EBDA_SCAN     0x400
+#define BIOS_START    0xe0000
+#define BIOS_END      0x100000
+
+/* 0 if not found yet, scanned once */
+uint32_t __use_section_data acpi_rsdp_addr = 0;
+int __use_section_data acpi_scanned = 0;
+uint32_t __use_section_data acpi_slit_addr = 0;
+int __use_section_data acpi_slit_probed = 0;
+
+struct acpi_info __use_section_data acpi;
+
+static uint8_t checksum(const void *p, uint32_t len)
+{
+	const uint8_t *b = p;
+	uint8_t sum = 0;
+
+	while (len--) {
+		sum += *b++;
+	}
+
+	return sum;
+}
+
+/* bios data area, through asm: gcc treats the first page as null */
+static inline uint16_t bda_read16(uint32_t off)
+{
+	uint16_t v;
+	__asm__ volatile ("movw (%1), %0" : "=r" (v) : "r" (off));
+	return v;
+}
+
+static const struct acpi_rsdp *rsdp_scan(uint32_t start, uint32_t end)
+{
+	const struct acpi_rsdp *r;
+
+	/* 16 byte boundaries */
+	for (uint32_t p = start; p + sizeof(*r) <= end; p += 16) {
+		r = (const struct acpi_rsdp *) (uintptr_t) p;
+		if (memcmp(r->signature, "RSD PTR ", 8) || checksum(r, 20)) {
+			continue;
+		}
+
+		if (r->revision >= 2 && checksum(r, r->length)) {
+			continue;
+		}
+
+		return r;
+	}
+
+	return 0;
+}
+
+const struct acpi_rsdp *acpi_rsdp(void)
+{
+	const struct acpi_rsdp *r = 0;
+	uint32_t ebda;
+
+	if (acpi_scanned) {
+		return (const struct acpi_rsdp *) (uintptr_t) acpi_rsdp_addr;
+	}
+
+	/* first kb of the ebda, then the bios area */
+	ebda = ((uint32_t) bda_read16(EBDA_SEG_PTR)) << 4;
+	if (ebda >= 0x80000 && ebda < 0xa0000) {
+		r = rsdp_scan(ebda, ebda + EBDA_SCAN);
+	}
+
+	if (!r) {
+		r = rsdp_scan(BIOS_START, BIOS_END);
+	}
+
+	acpi_rsdp_addr = (uint32_t) (uintptr_t) r;
+	acpi_scanned = 1;
+	return r;
+}
+
+/* reachable and has a header, the checksum is left to valid_table() */
+static const struct acpi_sdt *table_at(uint64_t addr)
+{
+	const struct acpi_sdt *t;
+
+	if (!addr || (addr >> 32)) {
+		return 0;
+	}
+
+	t = (const struct acpi_sdt *) (uintptr_t) addr;
+	return (t->length < sizeof(*t)) ? 0 : t;
+}
+
+static const struct acpi_sdt *valid_table(uint64_t addr)
+{
+	const struct acpi_sdt *t = table_at(addr);
+
+	return (t && !checksum(t, t->length)) ? t : 0;
+}
+
+/* nth table with that signature, xsdt preferred */
+const struct acpi_sdt *acpi_find_table(const char *signature, uint32_t instance)
+{
+	const struct acpi_rsdp *r = acpi_rsdp();
+	const struct acpi_sdt *root = 0, *t;
+	uint32_t entsize, count;
+	const uint8_t *ent;
+	uint64_t addr;
+
+	if (!r) {
+		return 0;
+	}
+
+	if (r->revision >= 2) {
+		root = valid_table(r->xsdt);
+	}
+
+	entsize = root ? 8 : 4;
+	if (!root) {
+		root = valid_table(r->rsdt);
+	}
+
+	if (!root) {
+		return 0;
+	}
+
+	count = (root->length - sizeof(*root)) / entsize;
+	ent = (const uint8_t *) (root + 1);
+
+	for (uint32_t i = 0; i < count; i++, ent += entsize) {
+		addr = (entsize == 8) ? *(const uint64_t *) ent : *(const uint32_t *) ent;
+
+		/* only a matching signature is worth a checksum */
+		t = table_at(addr);
+		if (!t || memcmp(t->signature, signature, 4) || checksum(t, t->length)) {
+			continue;
+		}
+
+		if (!instance--) {
+			return t;
+		}
+	}
+
+	return 0;
+}
+
+static void iter_init(struct acpi_iter *it, const struct acpi_sdt *t,
+	uint32_t fixed)
+{
+	it->p = (const uint8_t *) t + fixed;
+	it->end = (const uint8_t *) t + t->length;
+}
+
+int acpi_madt_iter(struct acpi_iter *it)
+{
+	const struct acpi_sdt *t = acpi_find_table("APIC", 0);
+
+	if (!t || t->length < sizeof(struct acpi_madt)) {
+		return -1;
+	}
+
+	iter_init(it, t, sizeof(struct acpi_madt));
+	return 0;
+}
+
+int acpi_srat_iter(struct acpi_iter *it)
+{
+	const struct acpi_sdt *t = acpi_find_table("SRAT", 0);
+
+	if (!t || t->length < sizeof(struct acpi_srat)) {
+		return -1;
+	}
+
+	iter_init(it, t, sizeof(struct acpi_srat));
+	return 0;
+}
+
+/* next subtable of that type (ACPI_ANY for all), 0 at the end */
+const void *acpi_next(struct acpi_iter *it, uint8_t type)
+{
+	const struct acpi_subtable *s;
+
+	while (it->p + sizeof(*s) <= it->end) {
+		s = (const struct acpi_subtable *) it->p;
+		if (s->length < sizeof(*s) || it->p + s->length > it->end) {
+			break;
+		}
+
+		it->p += s->length;
+		if (type == ACPI_ANY || s->type == type) {
+			return s;
+		}
+	}
+
+	it->p = it->end;
+	return 0;
+}
+
+/* looked up once, acpi_slit_distance() is called per cpu pair */
+static const struct acpi_slit *slit(void)
+{
+	const struct acpi_slit *t;
+
+	if (acpi_slit_probed) {
+		return (const struct acpi_slit *) (uintptr_t) acpi_slit_addr;
+	}
+
+	t = (const struct acpi_slit *) acpi_find_table("SLIT", 0);
+	if (t && (t->hdr.length < sizeof(*t) || (t->localities >> 16) ||
+		sizeof(*t) + t->localities * t->localities > t->hdr.length)) {
+		t = 0;
+	}
+
+	acpi_slit_addr = (uint32_t) (uintptr_t) t;
+	acpi_slit_probed = 1;
+	return t;
+}
+
+uint32_t acpi_slit_localities(void)
+{
+	const struct acpi_slit *t = slit();
+	return t ? (uint32_t) t->localities : 0;
+}
+
+/* relative distance (10: local), 10/20 guess without a slit */
+uint8_t acpi_slit_distance(uint32_t from, uint32_t to)
+{
+	const struct acpi_slit *t = slit();
+
+	if (!t || from >= t->localities || to >= t->localities) {
+		return (from == to) ? 10 : 20;
+	}
+
+	return t->entry[from * (uint32_t) t->localities + to];
+}
+
+/* index in acpi.apic_id[], -1 if unknown */
+int acpi_cpu_index(uint32_t apic_id)
+{
+	for (uint32_t i = 0; i < acpi.ncpu; i++) {
+		if (acpi.apic_id[i] == apic_id) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static void madt_parse(void)
+{
+	const struct acpi_madt *madt = (const struct acpi_madt *) acpi_find_table("APIC", 0);
+	const struct acpi_subtable *s;
+	struct acpi_iter it;
+
+	if (madt) {
+		acpi.lapic_addr = madt->lapic_addr;
+	}
+
+	if (acpi_madt_iter(&it) < 0) {
+		return;
+	}
+
+	while ((s = acpi_next(&it, ACPI_ANY))) {
+		const struct acpi_madt_lapic *l = (const void *) s;
+		const struct acpi_madt_x2apic *x = (const void *) s;
+		const struct acpi_madt_ioapic *io = (const void *) s;
+		const struct acpi_madt_lapic_override *o = (const void *) s;
+
+		switch (s->type) {
+			case ACPI_MADT_LAPIC:
+				if ((l->flags & ACPI_MADT_ENABLED) && acpi.ncpu < ACPI_MAXCPU) {
+					acpi.apic_id[acpi.ncpu++] = l->apic_id;
+				}
+				break;
+
+			case ACPI_MADT_X2APIC:
+				if ((x->flags & ACPI_MADT_ENABLED) && acpi.ncpu < ACPI_MAXCPU &&
+					acpi_cpu_index(x->x2apic_id) < 0) {
+					acpi.apic_id[acpi.ncpu++] = x->x2apic_id;
+				}
+				break;
+
+			case ACPI_MADT_IOAPIC:
+				if (acpi.nioapic < ACPI_MAXIOAPIC) {
+					acpi.ioapic[acpi.nioapic].id = io->id;
+					acpi.ioapic[acpi.nioapic].addr = io->addr;
+					acpi.ioapic[acpi.nioapic].gsi_base = io->gsi_base;
+					acpi.nioapic++;
+				}
+				break;
+
+			case ACPI_MADT_ISO:
+				if (acpi.niso < ACPI_MAXISO) {
+					acpi.iso[acpi.niso++] = *(const struct acpi_madt_iso *) s;
+				}
+				break;
+
+			case ACPI_MADT_LAPIC_OVERRIDE:
+				if (!(o->addr >> 32)) {
+					acpi.lapic_addr = (uint32_t) o->addr;
+				}
+				break;
+		}
+	}
+}
+
+static void srat_parse(void)
+{
+	const struct acpi_subtable *s;
+	struct acpi_iter it;
+	uint32_t domain;
+	int cpu;
+
+	acpi.ndomains = 1;
+	if (acpi_srat_iter(&it) < 0) {
+		return;
+	}
+
+	while ((s = acpi_next(&it, ACPI_ANY))) {
+		const struct acpi_srat_cpu *c = (const void *) s;
+		const struct acpi_srat_x2apic *x = (const void *) s;
+		const struct acpi_srat_mem *m = (const void *) s;
+
+		switch (s->type) {
+			case ACPI_SRAT_CPU:
+				domain = c->domain_lo | (c->domain_hi[0] << 8) |
+					(c->domain_hi[1] << 16) | (c->domain_hi[2] << 24);
+				cpu = acpi_cpu_index(c->apic_id);
+				if (!(c->flags & ACPI_SRAT_ENABLED) || cpu < 0) {
+					continue;
+				}
+				break;
+
+			case ACPI_SRAT_X2APIC:
+				domain = x->domain;
+				cpu = acpi_cpu_index(x->x2apic_id);
+				if (!(x->flags & ACPI_SRAT_ENABLED) || cpu < 0) {
+					continue;
+				}
+				break;
+
+			case ACPI_SRAT_MEM:
+				if (!(m->flags & ACPI_SRAT_ENABLED) || !m->length ||
+					acpi.nmem >= ACPI_MAXMEM) {
+					continue;
+				}
+
+				acpi.mem[acpi.nmem].base = m->base;
+				acpi.mem[acpi.nmem].length = m->length;
+				acpi.mem[acpi.nmem].domain = m->domain;
+				acpi.nmem++;
+				cpu = -1;
+				domain = m->domain;
+				break;
+
+			default:
+				continue;
+		}
+
+		if (cpu >= 0) {
+			acpi.cpu_domain[cpu] = domain;
+		}
+
+		if (domain + 1 > acpi.ndomains && domain < ACPI_MAXCPU) {
+			acpi.ndomains = domain + 1;
+		}
+	}
+}
+
+/* fills acpi, -1 without an rsdp. timed, it runs on every boot */
+int acpi_init(void)
+{
+	const struct acpi_hpet *hpet;
+	uint64_t tsc = rdtsc();
+
+	/* rescan, the time includes finding the rsdp */
+	acpi_scanned = 0;
+	memset(&acpi, 0, sizeof(acpi));
+	acpi.lapic_addr = APICBASE;
+	acpi.ndomains = 1;
+
+	if (!acpi_rsdp()) {
+		acpi.parse_cycles = rdtsc() - tsc;
+		return -1;
+	}
+
+	madt_parse();
+	srat_parse();
+
+	hpet = (const struct acpi_hpet *) acpi_find_table("HPET", 0);
+	if (hpet && hpet->base.space_id == 0 && !(hpet->base.address >> 32)) {
+		acpi.hpet_addr = (uint32_t) hpet->base.address;
+	}
+
+	acpi.parse_cycles = rdtsc() - tsc;
+	return 0;
+}
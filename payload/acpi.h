@@ -0,0 +1,217 @@
+/*
+ * acpi.h - acpi tables (rsdp, rsdt/xsdt, madt, hpet, srat, slit)
+ */
+
+#ifndef ACPI_H
+#define ACPI_H
+
+#include "inttypes.h"
+
+#pragma pack(push, 1)
+struct acpi_rsdp {
+	char     signature[8];      /* "RSD PTR " */
+	uint8_t  checksum;          /* first 20 bytes */
+	char     oem_id[6];
+	uint8_t  revision;          /* 0: acpi 1.0, 2: acpi 2.0+ */
+	uint32_t rsdt;
+	uint32_t length;            /* revision >= 2 */
+	uint64_t xsdt;
+	uint8_t  ext_checksum;      /* whole structure */
+	uint8_t  reserved[3];
+};
+
+struct acpi_sdt {
+	char     signature[4];
+	uint32_t length;
+	uint8_t  revision;
+	uint8_t  checksum;
+	char     oem_id[6];
+	char     oem_table_id[8];
+	uint32_t oem_revision;
+	uint32_t creator_id;
+	uint32_t creator_revision;
+};
+
+struct acpi_gas {
+	uint8_t  space_id;          /* 0: memory, 1: io */
+	uint8_t  bit_width;
+	uint8_t  bit_offset;
+	uint8_t  access_size;
+	uint64_t address;
+};
+
+struct acpi_hpet {
+	struct acpi_sdt hdr;        /* "HPET" */
+	uint32_t block_id;
+	struct acpi_gas base;
+	uint8_t  number;
+	uint16_t min_tick;
+	uint8_t  page_prot;
+};
+
+/* madt, srat: a fixed part followed by type/length subtables */
+struct acpi_subtable {
+	uint8_t  type;
+	uint8_t  length;
+};
+
+struct acpi_madt {
+	struct acpi_sdt hdr;        /* "APIC" */
+	uint32_t lapic_addr;
+	uint32_t flags;             /* 1: dual 8259 present */
+};
+
+#define ACPI_MADT_LAPIC          0
+#define ACPI_MADT_IOAPIC         1
+#define ACPI_MADT_ISO            2  /* interrupt source override */
+#define ACPI_MADT_LAPIC_NMI      4
+#define ACPI_MADT_LAPIC_OVERRIDE 5
+#define ACPI_MADT_X2APIC         9
+
+#define ACPI_MADT_ENABLED        1
+#define ACPI_MADT_ONLINE_CAPABLE 2
+
+struct acpi_madt_lapic {
+	struct acpi_subtable hdr;
+	uint8_t  uid;
+	uint8_t  apic_id;
+	uint32_t flags;
+};
+
+struct acpi_madt_ioapic {
+	struct acpi_subtable hdr;
+	uint8_t  id;
+	uint8_t  reserved;
+	uint32_t addr;
+	uint32_t gsi_base;
+};
+
+struct acpi_madt_iso {
+	struct acpi_subtable hdr;
+	uint8_t  bus;               /* 0: isa */
+	uint8_t  source;            /* isa irq */
+	uint32_t gsi;
+	uint16_t flags;             /* mps inti flags: polarity, trigger */
+};
+
+struct acpi_madt_lapic_override {
+	struct acpi_subtable hdr;
+	uint16_t reserved;
+	uint64_t addr;
+};
+
+struct acpi_madt_x2apic {
+	struct acpi_subtable hdr;
+	uint16_t reserved;
+	uint32_t x2apic_id;
+	uint32_t flags;
+	uint32_t uid;
+};
+
+struct acpi_srat {
+	struct acpi_sdt hdr;        /* "SRAT" */
+	uint32_t reserved1;
+	uint64_t reserved2;
+};
+
+#define ACPI_SRAT_CPU            0
+#define ACPI_SRAT_MEM            1
+#define ACPI_SRAT_X2APIC         2
+
+#define ACPI_SRAT_ENABLED        1
+#define ACPI_SRAT_HOTPLUG        2
+
+struct acpi_srat_cpu {
+	struct acpi_subtable hdr;
+	uint8_t  domain_lo;
+	uint8_t  apic_id;
+	uint32_t flags;
+	uint8_t  sapic_eid;
+	uint8_t  domain_hi[3];
+	uint32_t clock_domain;
+};
+
+struct acpi_srat_mem {
+	struct acpi_subtable hdr;
+	uint32_t domain;
+	uint16_t reserved1;
+	uint64_t base;
+	uint64_t length;
+	uint32_t reserved2;
+	uint32_t flags;
+	uint64_t reserved3;
+};
+
+struct acpi_srat_x2apic {
+	struct acpi_subtable hdr;
+	uint16_t reserved1;
+	uint32_t domain;
+	uint32_t x2apic_id;
+	uint32_t flags;
+	uint32_t clock_domain;
+	uint32_t reserved2;
+};
+
+struct acpi_slit {
+	struct acpi_sdt hdr;        /* "SLIT" */
+	uint64_t localities;
+	uint8_t  entry[];           /* localities * localities */
+};
+#pragma pack(pop)
+
+#define ACPI_ANY        0xff
+
+#define ACPI_MAXCPU     64
+#define ACPI_MAXIOAPIC  8
+#define ACPI_MAXISO     16
+#define ACPI_MAXMEM     16
+
+struct acpi_iter {
+	const uint8_t *p;
+	const uint8_t *end;
+};
+
+struct acpi_ioapic {
+	uint8_t  id;
+	uint32_t addr;
+	uint32_t gsi_base;
+};
+
+struct acpi_memrange {
+	uint64_t base;
+	uint64_t length;
+	uint32_t domain;
+};
+
+/* summary filled by acpi_init(), no allocation */
+struct acpi_info {
+	uint32_t lapic_addr;
+	uint32_t hpet_addr;         /* 0 if none */
+	uint32_t ncpu;              /* enabled lapic + x2apic entries */
+	uint32_t apic_id[ACPI_MAXCPU];
+	uint32_t cpu_domain[ACPI_MAXCPU];  /* from srat, 0 without one */
+	uint32_t nioapic;
+	struct acpi_ioapic ioapic[ACPI_MAXIOAPIC];
+	uint32_t niso;
+	struct acpi_madt_iso iso[ACPI_MAXISO];
+	uint32_t nmem;
+	struct acpi_memrange mem[ACPI_MAXMEM];
+	uint32_t ndomains;          /* 1 + highest domain, 1 without srat */
+	uint64_t parse_cycles;      /* tsc, whole acpi_init */
+};
+
+extern struct acpi_info acpi;
+
+/* physical tables, read with paging off (or below MAXVIRTADDR) */
+const struct acpi_rsdp *acpi_rsdp(void);
+const struct acpi_sdt *acpi_find_table(const char *signature, uint32_t instance);
+
+int acpi_init(void);
+int acpi_madt_iter(struct acpi_iter *it);
+int acpi_srat_iter(struct acpi_iter *it);
+const void *acpi_next(struct acpi_iter *it, uint8_t type);
+uint32_t acpi_slit_localities(void);
+uint8_t acpi_slit_distance(uint32_t from, uint32_t to);
+int acpi_cpu_index(uint32_t apic_id);
+
+#endif
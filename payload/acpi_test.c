@@ -0,0 +1,93 @@
+/*
+ * acpi_test.c - dump the discovered topology, time the parse
+ */
+
+#include "cpu.h"
+#include "acpi.h"
+#include "video.h"
+#include "lapic.h"
+#include "div64.h"
+#include "compiler.h"
+
+static void dump_madt(void)
+{
+	printf("madt: lapic at 0x%x, %u cpus:", acpi.lapic_addr, acpi.ncpu);
+	for (uint32_t i = 0; i < acpi.ncpu; i++) {
+		printf(" %u", acpi.apic_id[i]);
+	}
+	putchar('\n');
+
+	for (uint32_t i = 0; i < acpi.nioapic; i++) {
+		printf("madt: ioapic %u at 0x%x, gsi base %u\n", acpi.ioapic[i].id,
+			acpi.ioapic[i].addr, acpi.ioapic[i].gsi_base);
+	}
+
+	for (uint32_t i = 0; i < acpi.niso; i++) {
+		printf("madt: isa irq %u -> gsi %u, flags 0x%x\n", acpi.iso[i].source,
+			acpi.iso[i].gsi, acpi.iso[i].flags);
+	}
+}
+
+static void dump_numa(void)
+{
+	uint32_t n = acpi_slit_localities();
+
+	printf("srat: %u domains\n", acpi.ndomains);
+	for (uint32_t i = 0; i < acpi.ncpu; i++) {
+		printf("srat: cpu %u (apic %u) -> node %u\n", i, acpi.apic_id[i],
+			acpi.cpu_domain[i]);
+	}
+
+	for (uint32_t i = 0; i < acpi.nmem; i++) {
+		printf("srat: mem 0x%llx-0x%llx -> node %u\n", acpi.mem[i].base,
+			acpi.mem[i].base + acpi.mem[i].length - 1, acpi.mem[i].domain);
+	}
+
+	if (!n) {
+		return;
+	}
+
+	printf("slit: %u localities\n", n);
+	for (uint32_t i = 0; i < n; i++) {
+		printf("slit:");
+		for (uint32_t j = 0; j < n; j++) {
+			printf(" %3u", acpi_slit_distance(i, j));
+		}
+		putchar('\n');
+	}
+}
+
+void __entry startup32()
+{
+	const struct acpi_rsdp *r;
+	uint32_t tsc_per_us;
+
+	cli();
+	x86_cpu_init();
+	apic_init();
+	sti();
+
+	puts("[acpi_test]: start\n");
+
+	if (acpi_init() < 0) {
+		printf("*** acpi: no rsdp ***\n");
+		__halt();
+	}
+
+	r = acpi_rsdp();
+	tsc_per_us = apic_tsc_per_ms() / 1000;
+	printf("acpi: rsdp at 0x%x, revision %u, parsed in %llu cycles (%u us)\n",
+		(uint32_t) r, r->revision, acpi.parse_cycles,
+		tsc_per_us ? (uint32_t) div_u64(acpi.parse_cycles, tsc_per_us) : 0);
+
+	dump_madt();
+	printf("hpet: 0x%x\n", acpi.hpet_addr);
+	dump_numa();
+
+	if (acpi.ncpu != MAXCPU) {
+		printf("note: %u cpus found, payloads assume %u\n", acpi.ncpu, MAXCPU);
+	}
+
+	puts("[acpi_test]: end\n");
+	payload_done();
+}
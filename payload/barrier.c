@@ -0,0 +1,162 @@
+/*
+ * barrier.c - centralized, dissemination and topology tree barriers
+ *
+ * all spin, nothing parks: meant for lining up benchmark phases. every
+ * participant calls barrier_wait with its own apic id as the cpu index.
+ */
+
+#include "cpu.h"
+#include "lapic.h"
+#include "barrier.h"
+#include "compiler.h"
+
+static inline uint32_t xadd(volatile uint32_t *p, uint32_t v)
+{
+	__asm__ volatile ("lock xaddl %0, %1" : "+r" (v), "+m" (*p) :: "memory");
+	return v;
+}
+
+static inline void spin_until_sense(struct barrier *b, uint32_t sense)
+{
+	while (b->sense != sense) {
+		__asm__ volatile ("pause");
+	}
+}
+
+static void central_wait(struct barrier *b, struct barrier_cpu *c)
+{
+	c->sense ^= 1;
+	if (xadd(&b->count, 1) == b->n - 1) {
+		b->count = 0;
+		b->sense = c->sense;
+	} else {
+		spin_until_sense(b, c->sense);
+	}
+}
+
+/* round r: tell cpu + 2^r, wait for cpu - 2^r. episodes only grow */
+static void dissemination_wait(struct barrier *b, struct barrier_cpu *c, uint32_t cpu)
+{
+	uint32_t ep = ++c->episode;
+
+	for (uint32_t r = 0; r < b->rounds; r++) {
+		b->cpu[(cpu + (1u << r)) % b->n].flag[r] = ep;
+		while ((int32_t) (c->flag[r] - ep) < 0) {
+			__asm__ volatile ("pause");
+		}
+	}
+}
+
+/* the last to arrive at a node goes on up, the last at the root releases */
+static void tree_wait(struct barrier *b, struct barrier_cpu *c, uint32_t cpu)
+{
+	struct barrier_node *node;
+
+	c->sense ^= 1;
+	for (uint32_t l = 0; l < b->levels; l++) {
+		node = &b->node[l][cpu >> b->shift[l]];
+		if (xadd(&node->count, 1) != node->expect - 1) {
+			spin_until_sense(b, c->sense);
+			return;
+		}
+		node->count = 0;
+	}
+
+	b->sense = c->sense;
+}
+
+/* children of each tree node: distinct groups one level down */
+static void tree_init(struct barrier *b)
+{
+	uint32_t smt, llc, shifts[BARRIER_LEVELS], below, seen;
+
+	x86_topology_shifts(&smt, &llc);
+	shifts[0] = smt;
+	shifts[1] = llc;
+	shifts[2] = 8;
+
+	b->levels = 0;
+	for (uint32_t i = 0; i < BARRIER_LEVELS; i++) {
+		if (shifts[i] && (!b->levels || shifts[i] > b->shift[b->levels - 1])) {
+			b->shift[b->levels++] = shifts[i];
+		}
+	}
+
+	for (uint32_t l = 0; l < b->levels; l++) {
+		for (uint32_t g = 0; g < MAXCPU; g++) {
+			seen = 0;
+			b->node[l][g].count = 0;
+			b->node[l][g].expect = 0;
+
+			for (uint32_t cpu = 0; cpu < b->n; cpu++) {
+				below = l ? cpu >> b->shift[l - 1] : cpu;
+				if ((cpu >> b->shift[l]) == g && !(seen & (1u << below))) {
+					seen |= 1u << below;
+					b->node[l][g].expect++;
+				}
+			}
+		}
+	}
+}
+
+/* before anyone waits on it */
+int barrier_init(struct barrier *b, uint32_t type, uint32_t n)
+{
+	if (type >= BARRIER_TYPES || n < 1 || n > MAXCPU) {
+		return -1;
+	}
+
+	b->type = type;
+	b->n = n;
+	b->count = 0;
+	b->sense = 0;
+
+	for (b->rounds = 0; (1u << b->rounds) < n; b->rounds++)
+		;
+
+	for (uint32_t cpu = 0; cpu < MAXCPU; cpu++) {
+		b->cpu[cpu].sense = 0;
+		b->cpu[cpu].episode = 0;
+		for (uint32_t r = 0; r < BARRIER_ROUNDS; r++) {
+			b->cpu[cpu].flag[r] = 0;
+		}
+	}
+
+	if (type == BARRIER_TREE) {
+		tree_init(b);
+	}
+
+	return 0;
+}
+
+void barrier_wait(struct barrier *b)
+{
+	uint32_t cpu = apic_id();
+	struct barrier_cpu *c = &b->cpu[cpu];
+
+	switch (b->type) {
+	case BARRIER_DISSEMINATION:
+		dissemination_wait(b, c, cpu);
+		break;
+	case BARRIER_TREE:
+		tree_wait(b, c, cpu);
+		break;
+	default:
+		central_wait(b, c);
+		break;
+	}
+}
+
+const char *barrier_name(uint32_t type)
+{
+	switch (type) {
+	case BARRIER_CENTRAL:
+		return "central";
+	case BARRIER_DISSEMINATION:
+		return "dissemination";
+	case BARRIER_TREE:
+		return "tree";
+	}
+
+	return "?";
+}
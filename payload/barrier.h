@@ -0,0 +1,48 @@
+/*
+ * barrier.h - centralized, dissemination and topology tree barriers
+ */
+
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include "cpu.h"
+#include "inttypes.h"
+#include "compiler.h"
+
+#define BARRIER_CENTRAL        0   /* one counter, sense reversal */
+#define BARRIER_DISSEMINATION  1   /* log2(n) rounds of pairwise flags */
+#define BARRIER_TREE           2   /* smt core, llc, all; last arriver climbs */
+#define BARRIER_TYPES          3
+
+#define BARRIER_ROUNDS         8   /* dissemination, up to 256 cpus */
+#define BARRIER_LEVELS         3
+
+struct barrier_cpu {
+	volatile uint32_t flag[BARRIER_ROUNDS];  /* dissemination, last episode seen */
+	uint32_t sense;
+	uint32_t episode;
+} __align(64);
+
+struct barrier_node {
+	volatile uint32_t count;
+	uint32_t expect;
+} __align(64);
+
+/* participants are apic ids 0..n-1 */
+struct barrier {
+	volatile uint32_t count;
+	volatile uint32_t sense;
+	uint32_t type;
+	uint32_t n;
+	uint32_t rounds;
+	uint32_t levels;
+	uint32_t shift[BARRIER_LEVELS];
+	struct barrier_cpu cpu[MAXCPU];
+	struct barrier_node node[BARRIER_LEVELS][MAXCPU];
+} __align(64);
+
+int barrier_init(struct barrier *b, uint32_t type, uint32_t n);
+void barrier_wait(struct barrier *b);
+const char *barrier_name(uint32_t type);
+
+#endif
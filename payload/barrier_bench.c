@@ -0,0 +1,143 @@
+/*
+ * barrier_bench.c - barrier episode latency and exit skew, 2..n cpus
+ */
+
+#include "cpu.h"
+#include "entry.h"
+#include "video.h"
+#include "div64.h"
+#include "lapic.h"
+#include "tsc.h"
+#include "barrier.h"
+#include "compiler.h"
+
+#define WARMUP_EPISODES  1000
+#define LAT_EPISODES     10000
+#define SKEW_EPISODES    256
+
+PAYLOAD_STACKS(4096);
+struct barrier bar[MAXCPU + 1][BARRIER_TYPES];
+uint64_t exit_tsc[MAXCPU][SKEW_EPISODES];
+uint32_t latency[MAXCPU + 1][BARRIER_TYPES];
+volatile uint32_t __use_section_data cpus_up = 1;
+volatile uint32_t __use_section_data cpus = 0;
+
+/* max - min exit tsc per episode: min, average, max over the episodes */
+static void skew_report(uint32_t n, uint32_t type)
+{
+	uint64_t lo, hi, sum = 0, skew, smin = ~0ull, smax = 0;
+
+	for (uint32_t e = 0; e < SKEW_EPISODES; e++) {
+		lo = hi = exit_tsc[0][e];
+		for (uint32_t cpu = 1; cpu < n; cpu++) {
+			lo = (exit_tsc[cpu][e] < lo) ? exit_tsc[cpu][e] : lo;
+			hi = (exit_tsc[cpu][e] > hi) ? exit_tsc[cpu][e] : hi;
+		}
+
+		skew = hi - lo;
+		sum += skew;
+		smin = (skew < smin) ? skew : smin;
+		smax = (skew > smax) ? skew : smax;
+	}
+
+	printf("%4u %-14s %9u %9u %9u %9u\n", n, barrier_name(type), latency[n][type],
+		(uint32_t) smin, (uint32_t) div_u64(sum, SKEW_EPISODES), (uint32_t) smax);
+}
+
+/* every participating cpu, same barrier */
+static void bench_one(uint32_t n, uint32_t type, uint32_t cpu)
+{
+	struct barrier *b = &bar[n][type];
+	uint64_t t;
+
+	for (uint32_t e = 0; e < WARMUP_EPISODES; e++) {
+		barrier_wait(b);
+	}
+
+	t = rdtsc();
+	for (uint32_t e = 0; e < LAT_EPISODES; e++) {
+		barrier_wait(b);
+	}
+	t = rdtsc() - t;
+
+	if (cpu == 0) {
+		latency[n][type] = (uint32_t) div_u64(t, LAT_EPISODES);
+	}
+
+	for (uint32_t e = 0; e < SKEW_EPISODES; e++) {
+		barrier_wait(b);
+		exit_tsc[cpu][e] = tsc_global();
+	}
+
+	/* stamps complete, cpu 0 reports, then everyone moves on */
+	barrier_wait(b);
+	if (cpu == 0) {
+		skew_report(n, type);
+	}
+	barrier_wait(b);
+}
+
+static void bench_all(uint32_t cpu)
+{
+	uint32_t best;
+
+	for (uint32_t n = 2; n <= cpus; n++) {
+		if (cpu >= n) {
+			continue;
+		}
+
+		for (uint32_t type = 0; type < BARRIER_TYPES; type++) {
+			bench_one(n, type, cpu);
+		}
+
+		if (cpu == 0) {
+			best = 0;
+			for (uint32_t type = 1; type < BARRIER_TYPES; type++) {
+				best = (latency[n][type] < latency[n][best]) ? type : best;
+			}
+			printf("%4u fastest: %s\n", n, barrier_name(best));
+		}
+	}
+}
+
+void __entry startup32()
+{
+	uint8_t apicid = __apicid();
+	uint32_t smt, llc;
+
+	x86_basic_init(0);
+
+	if (apicid != 0) {
+		__asm__ volatile ("lock incl %0" : "+m" (cpus_up) :: "memory");
+		tsc_sync_ap();
+		while (!cpus) {
+			__asm__ volatile ("pause");
+		}
+		bench_all(apicid);
+		__halt();
+	}
+
+	puts("[barrier_bench]: start\n");
+	for (uint8_t i = 1; i < MAXCPU; i++) {
+		apic_init_thread(i, startup32);
+		apic_timer_wait_ms(100);
+		tsc_sync_bsp(i);
+	}
+
+	for (uint32_t n = 1; n <= cpus_up; n++) {
+		for (uint32_t type = 0; type < BARRIER_TYPES; type++) {
+			barrier_init(&bar[n][type], type, n);
+		}
+	}
+
+	x86_topology_shifts(&smt, &llc);
+	printf("%u cpus, apic id shifts smt %u llc %u, skew in tsc_global cycles\n",
+		cpus_up, smt, llc);
+	printf("cpus type           cycles  skew min  skew avg  skew max\n");
+	cpus = cpus_up;
+
+	bench_all(0);
+
+	puts("[barrier_bench]: end\n");
+	payload_done();
+}
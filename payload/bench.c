@@ -0,0 +1,32 @@
+/*
+ * bench.c - every benchmark registered in payload/benches, bsp only
+ */
+
+#include "cpu.h"
+#include "video.h"
+#include "lapic.h"
+#include "harness.h"
+#include "results.h"
+#include "compiler.h"
+
+void __entry startup32()
+{
+	cli();
+	x86_cpu_init();
+	apic_init();
+	sti();
+
+	puts("[bench]: start\n");
+	if (results_init("bench")) {
+		puts("results: no results region on the boot disk\n");
+	}
+
+	bench_run_all();
+
+	if (results_count()) {
+		printf("results: %u records %s\n", results_count(),
+			results_flush() ? "*** not written ***" : "written");
+	}
+	puts("[bench]: end\n");
+	payload_done();
+}
@@ -0,0 +1,71 @@
+/*
+ * basic.c - cost of single instructions and cpu-local operations
+ */
+
+#include "cpu.h"
+#include "lapic.h"
+#include "harness.h"
+#include "compiler.h"
+
+volatile uint32_t __use_section_data basic_word = 0;
+
+BENCH(rdtsc)
+{
+	for (uint32_t i = 0; i < iters; i++) {
+		rdtsc();
+	}
+}
+
+BENCH(lfence)
+{
+	for (uint32_t i = 0; i < iters; i++) {
+		__asm__ volatile ("lfence" ::: "memory");
+	}
+}
+
+BENCH(mfence)
+{
+	for (uint32_t i = 0; i < iters; i++) {
+		__asm__ volatile ("mfence" ::: "memory");
+	}
+}
+
+BENCH(pause)
+{
+	for (uint32_t i = 0; i < iters; i++) {
+		__asm__ volatile ("pause");
+	}
+}
+
+BENCH(cpuid)
+{
+	uint32_t a, b, c, d;
+
+	for (uint32_t i = 0; i < iters; i++) {
+		a = c = 0;
+		__cpuid(&a, &b, &c, &d);
+	}
+}
+
+BENCH(lock_add)
+{
+	for (uint32_t i = 0; i < iters; i++) {
+		__asm__ volatile ("lock addl $1, %0" : "+m" (basic_word) :: "memory");
+	}
+}
+
+BENCH(xchg)
+{
+	uint32_t v = 0;
+
+	for (uint32_t i = 0; i < iters; i++) {
+		__asm__ volatile ("xchgl %0, %1" : "+r" (v), "+m" (basic_word) :: "memory");
+	}
+}
+
+BENCH(apic_id)
+{
+	for (uint32_t i = 0; i < iters; i++) {
+		apic_id();
+	}
+}
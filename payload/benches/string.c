@@ -0,0 +1,46 @@
+/*
+ * string.c - memcpy/memset through the bound variants
+ */
+
+#include "string.h"
+#include "harness.h"
+#include "compiler.h"
+
+/* paging stays off, buffers well above the payload */
+#define STRING_SRC 0x1000000
+#define STRING_DST 0x2000000
+
+BENCH(memcpy_64)
+{
+	for (uint32_t i = 0; i < iters; i++) {
+		memcpy((void *) STRING_DST, (void *) STRING_SRC, 64);
+	}
+}
+
+BENCH(memcpy_4k)
+{
+	for (uint32_t i = 0; i < iters; i++) {
+		memcpy((void *) STRING_DST, (void *) STRING_SRC, 4096);
+	}
+}
+
+BENCH(memcpy_64k)
+{
+	for (uint32_t i = 0; i < iters; i++) {
+		memcpy((void *) STRING_DST, (void *) STRING_SRC, 65536);
+	}
+}
+
+BENCH(memset_4k)
+{
+	for (uint32_t i = 0; i < iters; i++) {
+		memset((void *) STRING_DST, 0, 4096);
+	}
+}
+
+BENCH(memset_64k)
+{
+	for (uint32_t i = 0; i < iters; i++) {
+		memset((void *) STRING_DST, 0, 65536);
+	}
+}
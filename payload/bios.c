@@ -0,0 +1,164 @@
+/*
+ * bios.c - int 13h from protected mode through the real mode thunk (realmode.S)
+ *
+ * bsp only, with the other cpus quiet: the call runs with the bios ivt,
+ * the pic back on its real mode vectors and every fixed apic vector held
+ * off (tpr 0xff). 64-bit payloads don't have the thunk, calls return -1.
+ */
+
+#include "cpu.h"
+#include "pic.h"
+#include "bios.h"
+#include "boot.h"
+#include "lapic.h"
+#include "video.h"
+#include "string.h"
+#include "compiler.h"
+
+#define INT13_EXT_CHECK  0x4100
+#define INT13_EXT_READ   0x4200
+#define INT13_EXT_WRITE  0x4300
+
+struct bios_dap {
+	uint8_t  size;
+	uint8_t  zero;
+	uint16_t count;
+	uint16_t offset;
+	uint16_t segment;
+	uint32_t lba_low;
+	uint32_t lba_high;
+} __attribute__((packed));
+
+extern uint8_t bios_thunk_start[] __hidden;
+extern uint8_t bios_thunk_end[] __hidden;
+extern uint8_t bios_thunk_intno[] __hidden;
+extern uint8_t bios_thunk_regs[] __hidden;
+
+#define THUNK_ADDR(x) (BIOS_THUNK + ((x) - bios_thunk_start))
+
+/* -1 in 64-bit payloads, otherwise regs hold what the bios returned */
+int bios_int(uint8_t intno, struct bios_regs *regs)
+{
+#ifdef __x86_64__
+	(void) intno;
+	(void) regs;
+	return -1;
+#else
+	uint32_t size = bios_thunk_end - bios_thunk_start;
+	uintptr_t flags;
+	uint8_t tpr;
+
+	if (size > BIOS_THUNK_MAX) {
+		printf("*** bios thunk too big: %u ***\n", size);
+		__halt();
+	}
+
+	memcpy((void *) BIOS_THUNK, bios_thunk_start, size);
+	*(uint8_t *) THUNK_ADDR(bios_thunk_intno) = intno;
+	memcpy((void *) THUNK_ADDR(bios_thunk_regs), regs, sizeof(*regs));
+
+	flags = irq_save();
+	tpr = apic_set_tpr(0xff);
+	pic_irq_remap(PIC1_REAL_M_OFFSET, PIC2_REAL_M_OFFSET);
+	pic_set_master_mask(0xb8); /* timer, keyboard, cascade, floppy */
+	pic_set_slave_mask(0x3e);  /* rtc, ide */
+	apic_extint(1);
+
+	((void (*)(void)) BIOS_THUNK)();
+
+	apic_extint(0);
+	pic_set_slave_mask(0xff);
+	pic_set_master_mask(0xff);
+	pic_irq_remap(PIC1_PROT_M_OFFSET, PIC2_PROT_M_OFFSET);
+	apic_set_tpr(tpr);
+	irq_restore(flags);
+
+	memcpy(regs, (void *) THUNK_ADDR(bios_thunk_regs), sizeof(*regs));
+	return 0;
+#endif
+}
+
+/* dl at boot, stored in the mbr copy bios loaded at 0x7c00 */
+uint8_t bios_boot_drive(void)
+{
+	return *(volatile uint8_t *) ((BOOTSEG << 4) + MBR_DRIVE_OFFSET);
+}
+
+static int disk_ext_present(uint8_t drive)
+{
+	struct bios_regs r = { 0 };
+
+	r.eax = INT13_EXT_CHECK;
+	r.ebx = 0x55aa;
+	r.edx = drive;
+	if (bios_int(0x13, &r) || (r.eflags & BIOS_CF) || (r.ebx & 0xffff) != 0xaa55) {
+		return 0;
+	}
+
+	/* bit 0: extended disk access (42h, 43h) */
+	return (r.ecx & 1) != 0;
+}
+
+static int disk_xfer(uint8_t drive, uint32_t op, uint32_t lba, uint32_t count)
+{
+	struct bios_dap *dap = (struct bios_dap *) BIOS_DAP;
+	struct bios_regs r = { 0 };
+
+	memset(dap, 0, sizeof(*dap));
+	dap->size = sizeof(*dap);
+	dap->count = (uint16_t) count;
+	dap->offset = BIOS_BOUNCE & 0xf;
+	dap->segment = BIOS_BOUNCE >> 4;
+	dap->lba_low = lba;
+
+	r.eax = op;
+	r.edx = drive;
+	r.esi = BIOS_DAP;
+	if (bios_int(0x13, &r) || (r.eflags & BIOS_CF)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/* count sectors, -1 when the bios lacks the extensions or fails */
+int bios_disk_read(uint8_t drive, uint32_t lba, void *buf, uint32_t count)
+{
+	uint8_t *p = buf;
+	uint32_t n;
+
+	if (!disk_ext_present(drive)) {
+		return -1;
+	}
+
+	for (; count; count -= n, lba += n, p += n * 512) {
+		n = (count < BIOS_BOUNCE_SECTORS) ? count : BIOS_BOUNCE_SECTORS;
+		if (disk_xfer(drive, INT13_EXT_READ, lba, n)) {
+			return -1;
+		}
+
+		memcpy(p, (void *) BIOS_BOUNCE, n * 512);
+	}
+
+	return 0;
+}
+
+int bios_disk_write(uint8_t drive, uint32_t lba, const void *buf, uint32_t count)
+{
+	const uint8_t *p = buf;
+	uint32_t n;
+
+	if (!disk_ext_present(drive)) {
+		return -1;
+	}
+
+	for (; count; count -= n, lba += n, p += n * 512) {
+		n = (count < BIOS_BOUNCE_SECTORS) ? count : BIOS_BOUNCE_SECTORS;
+		memcpy((void *) BIOS_BOUNCE, p, n * 512);
+		if (disk_xfer(drive, INT13_EXT_WRITE, lba, n)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
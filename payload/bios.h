@@ -0,0 +1,44 @@
+/*
+ * bios.h - real mode bios calls from protected mode (32-bit payloads)
+ */
+
+#ifndef BIOS_H
+#define BIOS_H
+
+/* low memory the thunk owns, below the mbr at 0x7c00 */
+#define BIOS_BOUNCE      0x1000  /* disk transfers, BIOS_BOUNCE_SECTORS */
+#define BIOS_BOUNCE_SECTORS 32
+#define BIOS_THUNK       0x5000  /* thunk code and data, copied per call */
+#define BIOS_THUNK_MAX   0x1000
+#define BIOS_DAP         0x6000  /* int 13h disk address packet */
+#define BIOS_STACK       0x7000  /* real mode stack top */
+
+#define BIOS_REGS_EAX    0
+#define BIOS_REGS_EBX    4
+#define BIOS_REGS_ECX    8
+#define BIOS_REGS_EDX    12
+#define BIOS_REGS_ESI    16
+#define BIOS_REGS_EDI    20
+#define BIOS_REGS_EBP    24
+#define BIOS_REGS_EFLAGS 28
+#define BIOS_REGS_DS     32
+#define BIOS_REGS_ES     34
+
+#define BIOS_CF          0x0001
+
+#ifndef __ASSEMBLY__
+#include "inttypes.h"
+
+struct bios_regs {
+	uint32_t eax, ebx, ecx, edx, esi, edi, ebp;
+	uint32_t eflags;          /* out only */
+	uint16_t ds, es;
+} __attribute__((packed));
+
+int bios_int(uint8_t intno, struct bios_regs *regs);
+uint8_t bios_boot_drive(void);
+int bios_disk_read(uint8_t drive, uint32_t lba, void *buf, uint32_t count);
+int bios_disk_write(uint8_t drive, uint32_t lba, const void *buf, uint32_t count);
+#endif
+
+#endif
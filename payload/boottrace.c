@@ -0,0 +1,70 @@
+/*
+ * boottrace.c - per-stage breakdown of the boot stage table
+ */
+
+#include "video.h"
+#include "div64.h"
+#include "lapic.h"
+#include "compiler.h"
+#include "boottrace.h"
+
+/* no pointers: the image is moved, not relocated */
+static const char boot_stage_names[BOOT_STAGES][16] = {
+	[BOOT_STAGE_LOAD_START]    = "load_start",
+	[BOOT_STAGE_LOAD_END]      = "load_end",
+	[BOOT_STAGE_UNPACK_START]  = "unpack_start",
+	[BOOT_STAGE_UNPACK_END]    = "unpack_end",
+	[BOOT_STAGE_HEAD]          = "head",
+	[BOOT_STAGE_SIPI]          = "sipi",
+	[BOOT_STAGE_CPU_INIT]      = "cpu_init",
+	[BOOT_STAGE_CPU_INIT_END]  = "cpu_init_end",
+	[BOOT_STAGE_APIC_INIT]     = "apic_init",
+	[BOOT_STAGE_CALIBRATE]     = "calibrate",
+	[BOOT_STAGE_CALIBRATE_END] = "calibrate_end",
+	[BOOT_STAGE_APIC_INIT_END] = "apic_init_end",
+	[BOOT_STAGE_PAGES]         = "pages",
+	[BOOT_STAGE_PAGES_END]     = "pages_end",
+};
+
+static uint32_t tsc_us(uint64_t tsc, uint32_t tsc_per_ms)
+{
+	return (uint32_t) div_u64(tsc * 1000, tsc_per_ms);
+}
+
+/*
+ * stages in the order reached, us since tsc 0 (reset) and since the
+ * previous stage of the same cpu: the time spent getting to the stage.
+ * the bsp's calibration converts all of them, ap tscs are taken as synced
+ */
+void boot_trace_print(void)
+{
+	const struct load_info *li = (const struct load_info *) ((BOOTSEG << 4) + MBR_LOAD_INFO_OFFSET);
+	uint32_t tsc_per_ms = apic_tsc_per_ms();
+	uint64_t prev, tsc;
+
+	if (tsc_per_ms == 0) {
+		puts("boot trace: apic_init first\n");
+		return;
+	}
+
+	for (uint8_t cpu = 0; cpu < BOOT_TIMES_CPUS; cpu++) {
+		prev = 0;
+		for (uint32_t s = 0; s < BOOT_STAGES; s++) {
+			tsc = boot_times(cpu)->tsc[s];
+			if (tsc == 0) {
+				continue;
+			}
+
+			/* head.S leaves the loader's stamps, these may be stale */
+			if ((s == BOOT_STAGE_UNPACK_START || s == BOOT_STAGE_UNPACK_END) &&
+				!(li->flags & LOAD_INFO_F_LZ4)) {
+				continue;
+			}
+
+			printf("boot: cpu=%u stage=%s at_us=%u delta_us=%u\n", cpu,
+				boot_stage_names[s], tsc_us(tsc, tsc_per_ms),
+				tsc_us(tsc - prev, tsc_per_ms));
+			prev = tsc;
+		}
+	}
+}
@@ -0,0 +1,32 @@
+/*
+ * boottrace.h - rdtsc at named boot stages (BOOT_STAGE_*, include/boot.h)
+ */
+
+#ifndef BOOTTRACE_H
+#define BOOTTRACE_H
+
+#include "cpu.h"
+#include "boot.h"
+#include "inttypes.h"
+
+static inline volatile struct boot_times *boot_times(uint8_t cpu)
+{
+	return &((volatile struct boot_times *) BOOT_TIMES)[cpu];
+}
+
+/* for another cpu's table: the bsp stamps BOOT_STAGE_SIPI */
+static inline void boot_stage_cpu(uint8_t cpu, uint32_t stage)
+{
+	if (cpu < BOOT_TIMES_CPUS) {
+		boot_times(cpu)->tsc[stage] = rdtsc();
+	}
+}
+
+static inline void boot_stage(uint32_t stage)
+{
+	boot_stage_cpu(__apicid(), stage);
+}
+
+void boot_trace_print(void);
+
+#endif
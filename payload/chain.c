@@ -0,0 +1,249 @@
+/*
+ * chain.c - multi-payload disks: pick a payload from the directory, run it
+ *
+ * bminstall puts this first when it gets more than one payload, the
+ * directory (include/chaindir.h) follows it on disk. every boot runs one
+ * payload: loaded like boot.S would (bda or high), its load_info in the
+ * mbr copy flagged LOAD_INFO_F_CHAIN, entered at its first byte. its bsp's
+ * payload_done() resets the machine and the state written back to the
+ * directory says what comes next, so each payload starts from a fresh
+ * machine. a payload that hits a __halt() error path stops the sequence:
+ * nothing after it runs until the machine is reset by hand, the loader
+ * then goes on with the next entry.
+ */
+
+#include "io.h"
+#include "cpu.h"
+#include "bios.h"
+#include "boot.h"
+#include "video.h"
+#include "lapic.h"
+#include "results.h"
+#include "chaindir.h"
+#include "compiler.h"
+#include "boottrace.h"
+
+#define BDA_MEM_KB      0x413 /* conventional memory in KB */
+#define KBC_DATA        0x60
+#define KBC_STATUS      0x64
+#define KBC_STATUS_OBF  0x01
+#define KBC_STATUS_AUX  0x20  /* the byte is from the mouse */
+
+#define SC_BREAK        0x80  /* scan code set 1 */
+#define SC_1            0x02  /* 1..9, 0 */
+#define SC_0            0x0b
+#define SC_ENTER        0x1c
+
+struct chain_dir chain_dir;
+uint32_t __use_section_data chain_lba = 0;
+uint8_t __use_section_data chain_drive = 0;
+
+static inline uint16_t bda_read16(uint32_t off)
+{
+	uint16_t v;
+	__asm__ volatile ("movw (%1), %0" : "=r" (v) : "r" (off));
+	return v;
+}
+
+static inline void bda_write16(uint32_t off, uint16_t v)
+{
+	__asm__ volatile ("movw %0, (%1)" :: "r" (v), "r" (off) : "memory");
+}
+
+static int chain_write(void)
+{
+	return bios_disk_write(chain_drive, chain_lba, &chain_dir, CHAIN_DIR_SECTORS);
+}
+
+/* make code of a key, 0 when none is waiting */
+static uint8_t kbd_poll(void)
+{
+	uint8_t status = inb(KBC_STATUS), sc;
+
+	if (!(status & KBC_STATUS_OBF)) {
+		return 0;
+	}
+
+	sc = inb(KBC_DATA);
+	return ((status & KBC_STATUS_AUX) || (sc & SC_BREAK)) ? 0 : sc;
+}
+
+/*
+ * a number and enter runs that payload, enter alone (or the timeout,
+ * 0 for none) runs all of them: -1
+ */
+static int chain_menu(uint32_t timeout_ms)
+{
+	uint64_t end = rdtsc() + (uint64_t) apic_tsc_per_ms() * timeout_ms;
+	uint32_t digits = 0, n = 0;
+	uint8_t sc;
+
+	for (uint32_t i = 0; i < chain_dir.count; i++) {
+		const struct chain_entry *e = &chain_dir.entry[i];
+
+		printf("  %2u  %-20s %6u sectors, %s, %s\n", i, e->name, e->info.sectors,
+			(e->info.flags & LOAD_INFO_F_LZ4) ? "lz4" : "raw",
+			(e->info.flags & LOAD_INFO_F_HIGH) ? "high" : "low");
+	}
+
+	if (timeout_ms) {
+		printf("number and enter runs one, enter runs all (in %u s): ", timeout_ms / 1000);
+	} else {
+		puts("number and enter runs one, enter runs all: ");
+	}
+
+	while (1) {
+		if (timeout_ms && !digits && rdtsc() > end) {
+			puts("\n");
+			return -1;
+		}
+
+		if ((sc = kbd_poll()) == 0) {
+			__asm__ volatile ("pause");
+			continue;
+		}
+
+		/* any key stops the timeout */
+		timeout_ms = 0;
+		if (sc >= SC_1 && sc <= SC_0 && digits < 2) {
+			n = n * 10 + (sc - SC_1 + 1) % 10;
+			putchar('0' + (sc - SC_1 + 1) % 10);
+			digits++;
+		} else if (sc == SC_ENTER) {
+			puts("\n");
+			if (!digits) {
+				return -1;
+			}
+
+			if (n < chain_dir.count) {
+				return (int) n;
+			}
+
+			printf("no payload %u: ", n);
+			n = digits = 0;
+		}
+	}
+}
+
+/* load entry i like boot.S, enter it in place of the loader */
+static void __attribute__((noreturn)) chain_run(uint32_t i)
+{
+	const struct chain_entry *e = &chain_dir.entry[i];
+	struct load_info *li = (struct load_info *) ((BOOTSEG << 4) + MBR_LOAD_INFO_OFFSET);
+	uint32_t *startup32 = (uint32_t *) ((BOOTSEG << 4) + STARTUP32_OFFSET);
+	uint32_t base = PAYLOAD_HIGH_BASE;
+	uint16_t kb;
+
+	/* below the loader's own reservation */
+	if (!(e->info.flags & LOAD_INFO_F_HIGH)) {
+		kb = (bda_read16(BDA_MEM_KB) - e->info.kbsize) & -e->info.kbalign;
+		base = (uint32_t) kb << 10;
+		if (base < BOOT_BOUNCE + BOOT_BOUNCE_SECTORS * 512) {
+			printf("*** chain: %s: no room below %u KB ***\n", e->name, bda_read16(BDA_MEM_KB));
+			__halt();
+		}
+
+		bda_write16(BDA_MEM_KB, kb);
+	}
+
+	printf("[chain]: %u: %s at 0x%x\n", i, e->name, base);
+	boot_stage(BOOT_STAGE_LOAD_START);
+	if (bios_disk_read(chain_drive, e->info.index, (void *) base, e->info.sectors)) {
+		printf("*** chain: %s: read error ***\n", e->name);
+		__halt();
+	}
+	boot_stage(BOOT_STAGE_LOAD_END);
+
+	/* what the payload, its aps and results.c read from the mbr copy */
+	*li = e->info;
+	li->flags |= LOAD_INFO_F_CHAIN;
+	*startup32 = base;
+
+	/* 32-bit protected mode, interrupts off, the stack boot.S leaves */
+	__asm__ volatile (
+		"cli\n"
+		"mov %0, %%esp\n"
+		"jmp *%1\n"
+		:: "i" (BOOTSEG << 4), "r" (base)
+	);
+	__builtin_unreachable();
+}
+
+/* a new run starts with an empty results region, the payloads append */
+static void chain_results_reset(void)
+{
+	if (results_init("chain") == 0) {
+		results_flush();
+	}
+}
+
+void __entry startup32()
+{
+	const struct load_info *li = (const struct load_info *) ((BOOTSEG << 4) + MBR_LOAD_INFO_OFFSET);
+	uint32_t timeout_ms = 0;
+	int pick;
+
+	cli();
+	x86_cpu_init();
+	apic_init();
+	sti();
+
+	/* the directory follows this image */
+	chain_drive = bios_boot_drive();
+	chain_lba = li->index + li->sectors;
+	if (bios_disk_read(chain_drive, chain_lba, &chain_dir, CHAIN_DIR_SECTORS)
+		|| chain_dir.magic != CHAIN_MAGIC || chain_dir.version != CHAIN_VERSION
+		|| chain_dir.count == 0 || chain_dir.count > CHAIN_MAX) {
+		puts("*** chain: no payload directory ***\n");
+		__halt();
+	}
+
+	for (uint32_t i = 0; i < chain_dir.count; i++) {
+		chain_dir.entry[i].name[sizeof(chain_dir.entry[i].name) - 1] = 0;
+	}
+
+	switch (chain_dir.state) {
+		case CHAIN_S_RUN_ALL:
+			if (chain_dir.next < chain_dir.count) {
+				break;
+			}
+
+			printf("[chain]: %u payloads done, results: bminstall --dump-results\n",
+				chain_dir.count);
+			chain_dir.state = CHAIN_S_DONE;
+			chain_write();
+			break;
+
+		case CHAIN_S_IDLE:
+			if (chain_dir.flags & CHAIN_F_RUN_ALL) {
+				chain_results_reset();
+				chain_dir.state = CHAIN_S_RUN_ALL;
+				break;
+			}
+
+			timeout_ms = CHAIN_MENU_SECONDS * 1000;
+			break;
+	}
+
+	if (chain_dir.state != CHAIN_S_RUN_ALL) {
+		printf("[chain]: %u payloads\n", chain_dir.count);
+		pick = chain_menu(timeout_ms);
+
+		/* one payload comes back to the menu after it */
+		chain_dir.state = (pick < 0) ? CHAIN_S_RUN_ALL : CHAIN_S_DONE;
+		chain_dir.next = (pick < 0) ? 0 : (uint32_t) pick;
+		chain_results_reset();
+	}
+
+	pick = (int) chain_dir.next;
+	if (chain_dir.state == CHAIN_S_RUN_ALL) {
+		chain_dir.next++;
+	}
+
+	if (chain_write()) {
+		puts("*** chain: directory write error ***\n");
+		__halt();
+	}
+
+	chain_run((uint32_t) pick);
+}
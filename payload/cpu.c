@@ -6,11 +6,19 @@
 #include "pic.h"
 #include "idt.h"
 #include "cpu.h"
+#include "lapic.h"
+#include "string.h"
+#include "chaindir.h"
+#include "boottrace.h"
 #include "compiler.h"
 #include "inttypes.h"
 
 extern unsigned long __stack_chk_guard; /* from stack.c */
 
+uint64_t __use_section_data x86_xcr0 = 0;
+uint32_t __use_section_data x86_xsave_size = 512; /* fxsave */
+int __use_section_data x86_xsaveopt = 0;
+
 static void fast_a20_enable(void)
 {
 	uint8_t b = inb(SYS_CTRL_PORTA);
@@ -25,7 +33,7 @@ static void x86_enable_sse(void)
 	__cpuid(&a, &b, &c, &d);
 
 	/* SSE */
-	if (d & 0x2000000) {
+	if (d & CPUID_1_EDX_SSE) {
 		__writecr0(__readcr0() & ~CR0_EM);
 		__writecr0(__readcr0() | CR0_MP);
 		__writecr4(__readcr4() | CR4_OSFXSR);
@@ -33,10 +41,214 @@ static void x86_enable_sse(void)
 	}
 }
 
+/* every state component the cpu has and we know how to switch */
+static void x86_enable_xsave(void)
+{
+	uint32_t a = 1, b = 0, c = 0, d = 0;
+	uint64_t supported, xcr0 = XCR0_X87 | XCR0_SSE;
+
+	__cpuid(&a, &b, &c, &d);
+	if (!(c & CPUID_1_ECX_XSAVE)) {
+		return;
+	}
+
+	__writecr4(__readcr4() | CR4_OSXSAVE);
+
+	a = 0xd;
+	c = 0;
+	__cpuid(&a, &b, &c, &d);
+	supported = ((uint64_t) d << 32) | a;
+
+	if (supported & XCR0_AVX) {
+		xcr0 |= XCR0_AVX;
+	}
+
+	/* avx-512 is all three or nothing */
+	if ((xcr0 & XCR0_AVX) && (supported & XCR0_AVX512) == XCR0_AVX512) {
+		xcr0 |= XCR0_AVX512;
+	}
+
+	if ((supported & XCR0_AMX) == XCR0_AMX) {
+		xcr0 |= XCR0_AMX;
+	}
+
+	__xsetbv(0, xcr0);
+
+	/* ebx: size for what xcr0 enables now */
+	a = 0xd;
+	c = 0;
+	__cpuid(&a, &b, &c, &d);
+	x86_xsave_size = b;
+
+	a = 0xd;
+	c = 1;
+	__cpuid(&a, &b, &c, &d);
+	x86_xsaveopt = (a & CPUID_D1_EAX_XSAVEOPT) != 0;
+	x86_xcr0 = xcr0;
+}
+
+/* last level cache size in bytes, 0 if unknown */
+uint32_t x86_llc_size(void)
+{
+	uint32_t a = 0, b = 0, c = 0, d = 0, max, size = 0, level = 0;
+
+	__cpuid(&a, &b, &c, &d);
+	max = a;
+
+	/* intel: deterministic cache parameters */
+	if ((b == 0x756e6547) && (max >= 4)) {
+		for (uint32_t i = 0; ; i++) {
+			a = 4;
+			c = i;
+			__cpuid(&a, &b, &c, &d);
+			if ((a & 0x1f) == 0) {
+				break;
+			}
+
+			if (((a >> 5) & 7) < level) {
+				continue;
+			}
+
+			/* ways * partitions * line size * sets */
+			level = (a >> 5) & 7;
+			size = (((b >> 22) & 0x3ff) + 1) * (((b >> 12) & 0x3ff) + 1) *
+				((b & 0xfff) + 1) * (c + 1);
+		}
+
+		return size;
+	}
+
+	/* amd: l3 (512K units), l2 (1K units) */
+	a = 0x80000000;
+	__cpuid(&a, &b, &c, &d);
+	if (a >= 0x80000006) {
+		a = 0x80000006;
+		__cpuid(&a, &b, &c, &d);
+		size = (d >> 18) ? (d >> 18) << 19 : (c >> 16) << 10;
+	}
+
+	return size;
+}
+
+/* bits of ceil(log2(n)) */
+static uint32_t order(uint32_t n)
+{
+	uint32_t s = 0;
+
+	while ((1u << s) < n) {
+		s++;
+	}
+
+	return s;
+}
+
+/* leaf 4 layout (0x8000001d too): last level sharing shift, -1 if no levels */
+static int cache_llc_shift(uint32_t leaf)
+{
+	uint32_t a, b, c, d, level = 0;
+	int shift = -1;
+
+	for (uint32_t i = 0; ; i++) {
+		a = leaf;
+		c = i;
+		__cpuid(&a, &b, &c, &d);
+		if ((a & 0x1f) == 0) {
+			break;
+		}
+
+		if (((a >> 5) & 7) >= level) {
+			level = (a >> 5) & 7;
+			shift = (int) order(((a >> 14) & 0xfff) + 1);
+		}
+	}
+
+	return shift;
+}
+
+/*
+ * apic id bits that select the thread within a core (smt) and the cpu
+ * within the last level cache domain (llc). 0 when the cpu doesn't say.
+ */
+void x86_topology_shifts(uint32_t *smt, uint32_t *llc)
+{
+	uint32_t a = 0, b = 0, c = 0, d = 0, max, ext;
+	int shift = -1;
+
+	*smt = *llc = 0;
+
+	__cpuid(&a, &b, &c, &d);
+	max = a;
+
+	/* extended topology: subleaf 0 is the smt level */
+	if (max >= 0xb) {
+		a = 0xb;
+		c = 0;
+		__cpuid(&a, &b, &c, &d);
+		if (b && ((c >> 8) & 0xff) == 1) {
+			*smt = a & 0x1f;
+		}
+	}
+
+	/* cache parameters: leaf 4, amd has no levels there but 0x8000001d */
+	a = 0x80000000;
+	__cpuid(&a, &b, &c, &d);
+	ext = a;
+	if (max >= 4) {
+		shift = cache_llc_shift(4);
+	}
+	if (shift < 0 && ext >= 0x8000001d) {
+		shift = cache_llc_shift(0x8000001d);
+	}
+
+	*llc = (shift < 0) ? 0 : (uint32_t) shift;
+	if (*llc < *smt) {
+		*llc = *smt;
+	}
+}
+
+/* port a fast reset (rising edge), a triple fault if that doesn't take */
+void x86_reset(void)
+{
+	struct {
+		uint16_t limit;
+		uintptr_t base;
+	} __attribute__((packed)) idtr = { 0, 0 };
+	uint8_t b;
+
+	cli();
+	b = inb(SYS_CTRL_PORTA) & ~CTRL_A_FLG_AHR;
+	outb(SYS_CTRL_PORTA, b);
+	outb(SYS_CTRL_PORTA, b | CTRL_A_FLG_AHR);
+
+	__asm__ volatile ("lidt %0; int3" :: "m" (idtr));
+	while (1) __asm__ volatile ("hlt");
+}
+
+/* the bsp's last call, once its aps are done: a chained payload resets to the next */
+void payload_done(void)
+{
+	const struct load_info *li = (const struct load_info *) ((BOOTSEG << 4) + MBR_LOAD_INFO_OFFSET);
+	uint64_t end;
+
+	if ((li->flags & LOAD_INFO_F_CHAIN) && __apicid() == 0) {
+		/* time to read the screen, once the tsc is calibrated */
+		end = rdtsc() + (uint64_t) apic_tsc_per_ms() * CHAIN_PAUSE_MS;
+		while (rdtsc() < end) {
+			__asm__ volatile ("pause");
+		}
+
+		x86_reset();
+	}
+
+	__halt();
+}
+
 void x86_cpu_init(void)
 {
 	uint64_t tsc = rdtsc();
 
+	boot_stage(BOOT_STAGE_CPU_INIT);
+
 	/* ensure a20 */
 	fast_a20_enable();
 
@@ -46,9 +258,15 @@ void x86_cpu_init(void)
 	/* init gates */
 	idt_init();
 
-	/* enable sse */
+	/* enable sse, then avx and up through xcr0 */
 	x86_enable_sse();
+	x86_enable_xsave();
+
+	/* bind memcpy, memset, ... */
+	string_init();
 
 	/* init stack guard */
 	__stack_chk_guard = (uint32_t) (tsc ^ (tsc >> 32));
+
+	boot_stage(BOOT_STAGE_CPU_INIT_END);
 }
@@ -44,6 +44,33 @@
 #define CR4_SMAP       0x00200000
 #define CR4_PKE        0x00400000
 
+/* cpuid feature bits */
+#define CPUID_1_ECX_TSC_DEADLINE (1 << 24)
+#define CPUID_1_ECX_XSAVE        (1 << 26)
+#define CPUID_1_ECX_AVX          (1 << 28)
+#define CPUID_1_EDX_FXSR         (1 << 24)
+#define CPUID_1_EDX_SSE          (1 << 25)
+#define CPUID_1_EDX_SSE2         (1 << 26)
+#define CPUID_7_EBX_AVX2         (1 << 5)
+#define CPUID_7_EBX_ERMS         (1 << 9)
+#define CPUID_7_EBX_AVX512F      (1 << 16)
+#define CPUID_7_EDX_FSRM         (1 << 4)
+#define CPUID_7_EDX_AMX_TILE     (1 << 24)
+#define CPUID_D1_EAX_XSAVEOPT    (1 << 0)
+#define CPUID_80000001_EDX_RDTSCP (1 << 27)
+
+/* xcr0 state components */
+#define XCR0_X87       0x00000001
+#define XCR0_SSE       0x00000002
+#define XCR0_AVX       0x00000004
+#define XCR0_OPMASK    0x00000020
+#define XCR0_ZMM_HI256 0x00000040
+#define XCR0_HI16_ZMM  0x00000080
+#define XCR0_AVX512    (XCR0_OPMASK | XCR0_ZMM_HI256 | XCR0_HI16_ZMM)
+#define XCR0_XTILECFG  0x00020000
+#define XCR0_XTILEDATA 0x00040000
+#define XCR0_AMX       (XCR0_XTILECFG | XCR0_XTILEDATA)
+
 #define SYS_CTRL_PORTA 0x92 /* System Control Port A */
 #define CTRL_A_FLG_AHR 1    /* alternate hot reset */
 #define CTRL_A_FLG_A20 2    /* a20 gate */
@@ -55,6 +82,15 @@
 
 
 void x86_cpu_init(void);
+void x86_reset(void) __attribute__((noreturn));
+void payload_done(void) __attribute__((noreturn));
+uint32_t x86_llc_size(void);
+void x86_topology_shifts(uint32_t *smt, uint32_t *llc);
+
+/* set by x86_cpu_init: enabled xcr0 (0 without xsave), save area size */
+extern uint64_t x86_xcr0;
+extern uint32_t x86_xsave_size;
+extern int x86_xsaveopt;
 
 static inline uint64_t rdtsc(void)
 {
@@ -63,6 +99,14 @@ static inline uint64_t rdtsc(void)
     return ((uint64_t) high << 32) | low;
 }
 
+/* needs CR4.PCE */
+static inline uint64_t rdpmc(uint32_t counter)
+{
+	uint32_t high, low;
+	__asm__ volatile ("rdpmc" : "=a"(low), "=d"(high) : "c"(counter));
+	return ((uint64_t) high << 32) | low;
+}
+
 static inline void
 cli(void) {
 	__asm__ volatile ("cli");
@@ -73,6 +117,21 @@ sti(void) {
 	__asm__ volatile ("sti");
 }
 
+/* eflags before cli, for irq_restore */
+static inline uintptr_t
+irq_save(void) {
+	uintptr_t flags;
+	__asm__ volatile ("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+	return flags;
+}
+
+static inline void
+irq_restore(uintptr_t flags) {
+	if (flags & 0x200) {
+		sti();
+	}
+}
+
 static inline void
 __cpuid(uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
 {
@@ -142,7 +201,7 @@ __rdmsr(uint32_t msr)
 {
 	uint32_t low = 0, high = 0;
 
-	__asm__("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+	__asm__ volatile ("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
 	return ((uint64_t) high << 32) | low;
 }
 
@@ -152,7 +211,26 @@ __wrmsr(uint32_t msr, uint64_t val)
 	uint32_t low = (uint32_t) val;
 	uint32_t high = (uint32_t) (val >> 32);
 
-	__asm__("wrmsr" : "=a"(low), "=d"(high) : "c"(msr));
+	__asm__ volatile ("wrmsr" :: "a"(low), "d"(high), "c"(msr) : "memory");
+}
+
+/* needs CR4.OSXSAVE */
+static inline uint64_t
+__xgetbv(uint32_t xcr)
+{
+	uint32_t low, high;
+
+	__asm__ volatile ("xgetbv" : "=a"(low), "=d"(high) : "c"(xcr));
+	return ((uint64_t) high << 32) | low;
+}
+
+static inline void
+__xsetbv(uint32_t xcr, uint64_t val)
+{
+	uint32_t low = (uint32_t) val;
+	uint32_t high = (uint32_t) (val >> 32);
+
+	__asm__ volatile ("xsetbv" :: "a"(low), "d"(high), "c"(xcr) : "memory");
 }
 
 #endif /* !__ASSEMBLY__ */
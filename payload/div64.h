@@ -0,0 +1,35 @@
+/*
+ * div64.h - 64-bit by 32-bit division without libgcc helpers
+ */
+
+#ifndef DIV64_H
+#define DIV64_H
+
+#include "inttypes.h"
+
+/* two divl steps, the high remainder keeps the second quotient in 32 bits */
+static inline uint64_t div_u64_rem(uint64_t n, uint32_t d, uint32_t *rem)
+{
+	uint32_t hi = (uint32_t) (n >> 32), lo = (uint32_t) n;
+	uint32_t qhi = 0, r;
+
+	if (hi >= d) {
+		qhi = hi / d;
+		hi %= d;
+	}
+
+	__asm__ ("divl %4" : "=a"(lo), "=d"(r) : "a"(lo), "d"(hi), "rm"(d));
+
+	if (rem) {
+		*rem = r;
+	}
+
+	return ((uint64_t) qhi << 32) | lo;
+}
+
+static inline uint64_t div_u64(uint64_t n, uint32_t d)
+{
+	return div_u64_rem(n, d, 0);
+}
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * entry.h - per-cpu stacks and basic bring-up at a payload's startup32
+ */
+
+#ifndef ENTRY_H
+#define ENTRY_H
+
+#include "cpu.h"
+#include "lapic.h"
+#include "paging.h"
+#include "compiler.h"
+#include "inttypes.h"
+
+/* x86_basic_init() flags */
+#define X86_INIT_PAGES  0x01 /* init_early_pages() */
+
+/*
+ * once per payload, at file scope: MAXCPU stacks of size bytes and
+ * set_thread_stack(), which moves the calling cpu to the top of its own
+ */
+#define PAYLOAD_STACKS(size)                                           \
+	typedef struct _stack32 {                                          \
+		uint8_t d[size];                                               \
+	} __align(16) stack32_t;                                           \
+                                                                       \
+	extern stack32_t pcpu_stack_32[MAXCPU];                            \
+                                                                       \
+	static inline __attribute__((always_inline))                       \
+	void set_thread_stack(void)                                        \
+	{                                                                  \
+		stack32_t *sp = &pcpu_stack_32[__apicid() + 1];                \
+		__asm__ volatile ("movl %0, %%esp" :: "m" (sp));               \
+	}                                                                  \
+                                                                       \
+	stack32_t pcpu_stack_32[MAXCPU]
+
+static inline __attribute__((always_inline)) void set_thread_stack(void);
+
+/* first thing in startup32 on every cpu, nothing on the old stack survives */
+static inline __attribute__((always_inline))
+void x86_basic_init(uint32_t flags)
+{
+	cli();
+	set_thread_stack();
+	x86_cpu_init();
+	apic_init();
+	if (flags & X86_INIT_PAGES) {
+		init_early_pages();
+	}
+	sti();
+}
+
+#endif
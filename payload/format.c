@@ -0,0 +1,356 @@
+/*
+ * format.c - vsnprintf core
+ */
+
+#include "video.h"
+#include "div64.h"
+#include "format.h"
+#include "inttypes.h"
+
+#define FMT_LEFT  1
+#define FMT_ZERO  2
+#define FMT_PLUS  4
+#define FMT_SPACE 8
+#define FMT_ALT   16
+
+/* sized for 2^64 in octal */
+#define FMT_NUMBUF 24
+
+struct fmt_out {
+	char *buf;
+	uint32_t size;
+	uint32_t len;
+	int console;   /* write to the screen, not to buf */
+};
+
+static const char digits2[200] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static const char xdigits[2][16] = {
+	{ '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f' },
+	{ '0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F' },
+};
+
+static inline void out_char(struct fmt_out *o, char c)
+{
+	if (o->console) {
+		__putchar(c);
+	} else if (o->len + 1 < o->size) {
+		o->buf[o->len] = c;
+	}
+
+	o->len++;
+}
+
+static inline void out_pad(struct fmt_out *o, char c, int n)
+{
+	while (n-- > 0) {
+		out_char(o, c);
+	}
+}
+
+/* two digits per step, backwards from end, at least minlen digits */
+static char *u32_to_dec(char *end, uint32_t v, int minlen)
+{
+	char *p = end;
+	uint32_t r;
+
+	while (v >= 100) {
+		r = (v % 100) * 2;
+		v /= 100;
+		p -= 2;
+		p[0] = digits2[r];
+		p[1] = digits2[r + 1];
+	}
+
+	if (v >= 10) {
+		p -= 2;
+		p[0] = digits2[v * 2];
+		p[1] = digits2[v * 2 + 1];
+	} else {
+		*--p = '0' + v;
+	}
+
+	while ((end - p) < minlen) {
+		*--p = '0';
+	}
+
+	return p;
+}
+
+/* split in base 10^9 chunks, no 64-bit division helpers needed */
+static char *u64_to_dec(char *end, uint64_t v)
+{
+	uint32_t rem;
+
+	while (v >> 32) {
+		v = div_u64_rem(v, 1000000000, &rem);
+		end = u32_to_dec(end, rem, 9);
+	}
+
+	return u32_to_dec(end, (uint32_t) v, 0);
+}
+
+static char *u64_to_base2n(char *end, uint64_t v, int shift, int upper)
+{
+	uint32_t mask = (1 << shift) - 1;
+
+	do {
+		*--end = xdigits[upper][(uint32_t) v & mask];
+		v >>= shift;
+	} while (v);
+
+	return end;
+}
+
+static void out_number(struct fmt_out *o, const char *digits, int ndigits,
+	const char *prefix, int flags, int width)
+{
+	int plen = 0, pad;
+
+	while (prefix[plen]) {
+		plen++;
+	}
+
+	pad = width - ndigits - plen;
+
+	if (!(flags & (FMT_LEFT | FMT_ZERO))) {
+		out_pad(o, ' ', pad);
+	}
+
+	while (*prefix) {
+		out_char(o, *prefix++);
+	}
+
+	if ((flags & (FMT_LEFT | FMT_ZERO)) == FMT_ZERO) {
+		out_pad(o, '0', pad);
+	}
+
+	while (ndigits--) {
+		out_char(o, *digits++);
+	}
+
+	if (flags & FMT_LEFT) {
+		out_pad(o, ' ', pad);
+	}
+}
+
+static void out_string(struct fmt_out *o, const char *s, int flags, int width,
+	int prec)
+{
+	int len = 0;
+
+	if (!s) {
+		s = "(null)";
+	}
+
+	while (s[len] && (prec < 0 || len < prec)) {
+		len++;
+	}
+
+	if (!(flags & FMT_LEFT)) {
+		out_pad(o, ' ', width - len);
+	}
+
+	for (int i = 0; i < len; i++) {
+		out_char(o, s[i]);
+	}
+
+	if (flags & FMT_LEFT) {
+		out_pad(o, ' ', width - len);
+	}
+}
+
+static int __vformat(struct fmt_out *o, const char *fmt, va_list ap)
+{
+	char numbuf[FMT_NUMBUF], *end = numbuf + FMT_NUMBUF, *digits;
+	int flags, width, prec, lmod;
+	const char *prefix;
+	uint64_t uv;
+	int64_t sv;
+	char c;
+
+	while ((c = *fmt++)) {
+		if (c != '%') {
+			out_char(o, c);
+			continue;
+		}
+
+		/* flags */
+		flags = 0;
+		for (;; fmt++) {
+			if (*fmt == '-') {
+				flags |= FMT_LEFT;
+			} else if (*fmt == '0') {
+				flags |= FMT_ZERO;
+			} else if (*fmt == '+') {
+				flags |= FMT_PLUS;
+			} else if (*fmt == ' ') {
+				flags |= FMT_SPACE;
+			} else if (*fmt == '#') {
+				flags |= FMT_ALT;
+			} else {
+				break;
+			}
+		}
+
+		/* width */
+		width = 0;
+		if (*fmt == '*') {
+			width = va_arg(ap, int);
+			if (width < 0) {
+				flags |= FMT_LEFT;
+				width = -width;
+			}
+			fmt++;
+		} else {
+			while (*fmt >= '0' && *fmt <= '9') {
+				width = width * 10 + (*fmt++ - '0');
+			}
+		}
+
+		/* precision (strings only) */
+		prec = -1;
+		if (*fmt == '.') {
+			fmt++;
+			prec = 0;
+			if (*fmt == '*') {
+				prec = va_arg(ap, int);
+				fmt++;
+			} else {
+				while (*fmt >= '0' && *fmt <= '9') {
+					prec = prec * 10 + (*fmt++ - '0');
+				}
+			}
+		}
+
+		/* length: l and z are the size of long, ll is 64 */
+		lmod = 0;
+		while (*fmt == 'l' || *fmt == 'h' || *fmt == 'z') {
+			c = *fmt++;
+			lmod += (c == 'l' || c == 'z');
+		}
+
+		if (lmod == 1 && sizeof(long) == 8) {
+			lmod = 2;
+		}
+
+		prefix = "";
+		switch ((c = *fmt++)) {
+			case 'c':
+				if (!(flags & FMT_LEFT)) {
+					out_pad(o, ' ', width - 1);
+				}
+
+				out_char(o, (char) va_arg(ap, int));
+
+				if (flags & FMT_LEFT) {
+					out_pad(o, ' ', width - 1);
+				}
+				break;
+
+			case 's':
+				out_string(o, va_arg(ap, const char *), flags, width, prec);
+				break;
+
+			case 'd':
+			case 'i':
+				sv = (lmod >= 2) ? va_arg(ap, int64_t) : va_arg(ap, int32_t);
+				uv = (sv < 0) ? -(uint64_t) sv : (uint64_t) sv;
+				prefix = (sv < 0) ? "-" : (flags & FMT_PLUS) ? "+" :
+					(flags & FMT_SPACE) ? " " : "";
+
+				digits = u64_to_dec(end, uv);
+				out_number(o, digits, end - digits, prefix, flags, width);
+				break;
+
+			case 'u':
+				uv = (lmod >= 2) ? va_arg(ap, uint64_t) : va_arg(ap, uint32_t);
+				digits = u64_to_dec(end, uv);
+				out_number(o, digits, end - digits, prefix, flags, width);
+				break;
+
+			case 'x':
+			case 'X':
+				uv = (lmod >= 2) ? va_arg(ap, uint64_t) : va_arg(ap, uint32_t);
+				if ((flags & FMT_ALT) && uv) {
+					prefix = (c == 'X') ? "0X" : "0x";
+				}
+
+				digits = u64_to_base2n(end, uv, 4, c == 'X');
+				out_number(o, digits, end - digits, prefix, flags, width);
+				break;
+
+			case 'o':
+				uv = (lmod >= 2) ? va_arg(ap, uint64_t) : va_arg(ap, uint32_t);
+				if ((flags & FMT_ALT) && uv) {
+					prefix = "0";
+				}
+
+				digits = u64_to_base2n(end, uv, 3, 0);
+				out_number(o, digits, end - digits, prefix, flags, width);
+				break;
+
+			case 'p':
+				uv = (unsigned long) va_arg(ap, void *);
+				digits = u64_to_base2n(end, uv, 4, 0);
+
+				/* 0x + all nibbles */
+				while ((end - digits) < (int) (2 * sizeof(void *))) {
+					*--digits = '0';
+				}
+
+				out_number(o, digits, end - digits, "0x", flags, width);
+				break;
+
+			case '%':
+				out_char(o, '%');
+				break;
+
+			case '\0':
+				fmt--;
+				break;
+
+			default:
+				out_char(o, '%');
+				out_char(o, c);
+		}
+	}
+
+	if (!o->console && o->size) {
+		o->buf[(o->len < o->size) ? o->len : o->size - 1] = '\0';
+	}
+
+	return o->len;
+}
+
+int vsnprintf(char *buf, uint32_t size, const char *fmt, va_list ap)
+{
+	/* size 0 only measures */
+	struct fmt_out o = { buf, size, 0, 0 };
+	return __vformat(&o, fmt, ap);
+}
+
+int snprintf(char *buf, uint32_t size, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf, size, fmt, ap);
+	va_end(ap);
+	return n;
+}
+
+int vprintf(const char *fmt, va_list ap)
+{
+	struct fmt_out o = { 0, 0, 0, 1 };
+	int n = __vformat(&o, fmt, ap);
+
+	video_setcursor();
+	return n;
+}
@@ -0,0 +1,18 @@
+/*
+ * format.h
+ */
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "inttypes.h"
+#include <stdarg.h>
+
+int vsnprintf(char *buf, uint32_t size, const char *fmt, va_list ap)
+	__attribute__((format (__printf__, 3, 0)));
+int snprintf(char *buf, uint32_t size, const char *fmt, ...)
+	__attribute__((format (__printf__, 3, 4)));
+int vprintf(const char *fmt, va_list ap)
+	__attribute__((format (__printf__, 1, 0)));
+
+#endif
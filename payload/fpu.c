@@ -0,0 +1,221 @@
+/*
+ * fpu.c - fpu context switch, eager or lazy (FPU_LAZY, cr0.ts and #nm)
+ */
+
+#include "cpu.h"
+#include "idt.h"
+#include "fpu.h"
+#include "numa.h"
+#include "lapic.h"
+#include "compiler.h"
+
+#define NM_VECTOR 7
+
+/* legacy region defaults, xrstor always loads mxcsr */
+#define FCW_OFFSET     0
+#define MXCSR_OFFSET   24
+#define FCW_DEFAULT    0x037f
+#define MXCSR_DEFAULT  0x1f80
+
+struct fpu_cpu {
+	struct fpu_ctx *current;  /* running context */
+	struct fpu_ctx *owner;    /* whose state is in the registers */
+	uint8_t *irq_area;        /* fpu_begin/fpu_end */
+	uint32_t irq_ts;
+	uint32_t faults;
+};
+
+struct fpu_cpu fpu_cpu[MAXCPU];
+
+static inline void clts(void)
+{
+	__asm__ volatile ("clts" ::: "memory");
+}
+
+static inline void stts(void)
+{
+	__writecr0(__readcr0() | CR0_TS);
+}
+
+void fpu_save(void *area)
+{
+	uint32_t low = (uint32_t) x86_xcr0, high = (uint32_t) (x86_xcr0 >> 32);
+
+	if (!x86_xcr0) {
+		__asm__ volatile ("fxsave (%0)" :: "r" (area) : "memory");
+	} else if (x86_xsaveopt) {
+		__asm__ volatile ("xsaveopt (%0)" :: "r" (area), "a" (low), "d" (high) : "memory");
+	} else {
+		__asm__ volatile ("xsave (%0)" :: "r" (area), "a" (low), "d" (high) : "memory");
+	}
+}
+
+void fpu_restore(const void *area)
+{
+	uint32_t low = (uint32_t) x86_xcr0, high = (uint32_t) (x86_xcr0 >> 32);
+
+	if (!x86_xcr0) {
+		__asm__ volatile ("fxrstor (%0)" :: "r" (area) : "memory");
+	} else {
+		__asm__ volatile ("xrstor (%0)" :: "r" (area), "a" (low), "d" (high) : "memory");
+	}
+}
+
+/* first use after a lazy switch: hand the registers to the running context */
+static void fpu_nm(isr_regs_t *regs __attribute__((unused)))
+{
+	struct fpu_cpu *c = &fpu_cpu[apic_id()];
+
+	clts();
+	if (!c->current || c->owner == c->current) {
+		return;
+	}
+
+	if (c->owner) {
+		fpu_save(c->owner->area);
+	}
+
+	fpu_restore(c->current->area);
+	c->owner = c->current;
+	c->faults++;
+}
+
+/*
+ * init state: x87 and sse defaults, every xsave component off. rep stosb,
+ * not memset: that may be the sse variant, and this runs with another
+ * context's vector state in the registers
+ */
+static void fpu_area_init(uint8_t *area)
+{
+	void *d = area;
+	uint32_t n = x86_xsave_size;
+
+	__asm__ volatile ("rep stosb" : "+D" (d), "+c" (n) : "a" (0) : "memory");
+	*(uint16_t *) (area + FCW_OFFSET) = FCW_DEFAULT;
+	*(uint32_t *) (area + MXCSR_OFFSET) = MXCSR_DEFAULT;
+}
+
+/* each cpu after x86_cpu_init, bsp first (numa_init) */
+int fpu_init(void)
+{
+	struct fpu_cpu *c;
+	uint8_t cpu = __apicid();
+
+	if (cpu >= MAXCPU || (!numa_ready() && numa_init() < 0)) {
+		return -1;
+	}
+
+	c = &fpu_cpu[cpu];
+	c->current = c->owner = 0;
+	c->faults = 0;
+	c->irq_area = numa_alloc_local(x86_xsave_size, FPU_AREA_ALIGN);
+	if (!c->irq_area) {
+		return -1;
+	}
+
+	/* xrstor #gps on a garbage xsave header */
+	fpu_area_init(c->irq_area);
+
+	if (cpu == 0) {
+		idt_set_handler(NM_VECTOR, fpu_nm);
+	}
+
+	return 0;
+}
+
+/* area on node, next to the thread that uses it */
+int fpu_ctx_init(struct fpu_ctx *ctx, uint32_t node)
+{
+	ctx->area = numa_alloc(node, x86_xsave_size, FPU_AREA_ALIGN);
+	if (!ctx->area) {
+		return -1;
+	}
+
+	fpu_area_init(ctx->area);
+	return 0;
+}
+
+/* back to init state for a new user, after fpu_ctx_release() */
+void fpu_ctx_reset(struct fpu_ctx *ctx)
+{
+	fpu_area_init(ctx->area);
+}
+
+/* on the cpu that ran ctx, once nothing runs on it anymore: never saved back */
+void fpu_ctx_release(struct fpu_ctx *ctx)
+{
+	struct fpu_cpu *c = &fpu_cpu[apic_id()];
+
+	if (c->owner == ctx) {
+		c->owner = 0;
+	}
+}
+
+#ifdef FPU_LAZY
+/* nothing moves until the next context touches the fpu */
+void fpu_switch(struct fpu_ctx *next)
+{
+	struct fpu_cpu *c = &fpu_cpu[apic_id()];
+
+	c->current = next;
+	if (c->owner == next) {
+		clts();
+	} else {
+		stts();
+	}
+}
+#else
+void fpu_switch(struct fpu_ctx *next)
+{
+	struct fpu_cpu *c = &fpu_cpu[apic_id()];
+
+	if (c->owner != next) {
+		if (c->owner) {
+			fpu_save(c->owner->area);
+		}
+
+		fpu_restore(next->area);
+		c->owner = next;
+	}
+
+	c->current = next;
+}
+#endif
+
+/*
+ * vector code in an interrupt handler: whatever is in the registers is put
+ * aside and restored, cr0.ts included. the handler itself stays
+ * general-regs-only, the vector code is a separate function. not nested.
+ */
+void fpu_begin(void)
+{
+	struct fpu_cpu *c = &fpu_cpu[apic_id()];
+
+	c->irq_ts = __readcr0() & CR0_TS;
+	clts();
+	fpu_save(c->irq_area);
+}
+
+void fpu_end(void)
+{
+	struct fpu_cpu *c = &fpu_cpu[apic_id()];
+
+	fpu_restore(c->irq_area);
+	if (c->irq_ts) {
+		stts();
+	}
+}
+
+int fpu_lazy(void)
+{
+#ifdef FPU_LAZY
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+uint32_t fpu_lazy_faults(uint8_t cpu)
+{
+	return (cpu < MAXCPU) ? fpu_cpu[cpu].faults : 0;
+}
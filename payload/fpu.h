@@ -0,0 +1,29 @@
+/*
+ * fpu.h - x87/sse/avx state per context, xsave based
+ */
+
+#ifndef FPU_H
+#define FPU_H
+
+#include "inttypes.h"
+
+#define FPU_AREA_ALIGN 64
+
+/* one per thread, the area is x86_xsave_size bytes */
+struct fpu_ctx {
+	uint8_t *area;
+};
+
+int fpu_init(void);
+int fpu_ctx_init(struct fpu_ctx *ctx, uint32_t node);
+void fpu_ctx_reset(struct fpu_ctx *ctx);
+void fpu_ctx_release(struct fpu_ctx *ctx);
+void fpu_switch(struct fpu_ctx *next);
+void fpu_save(void *area);
+void fpu_restore(const void *area);
+void fpu_begin(void);
+void fpu_end(void);
+int fpu_lazy(void);
+uint32_t fpu_lazy_faults(uint8_t cpu);
+
+#endif
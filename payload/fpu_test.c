@@ -0,0 +1,230 @@
+/*
+ * fpu_test.c - xcr0 components, context switch, interrupt handler and thread state
+ */
+
+#include "cpu.h"
+#include "fpu.h"
+#include "idt.h"
+#include "numa.h"
+#include "video.h"
+#include "div64.h"
+#include "lapic.h"
+#include "string.h"
+#include "thread.h"
+#include "compiler.h"
+
+#define SCRIBBLE_VECTOR 0x60
+#define COST_ITERS      1000
+#define VEC_MAX         64
+#define SLICE_US        1000
+
+/* built general-regs-only: the compiler never holds anything in vector registers here */
+uint8_t __align(64) pattern[3][VEC_MAX];
+uint8_t __align(64) readback[VEC_MAX];
+uint8_t __align(64) zero[VEC_MAX];
+struct fpu_ctx ctx[2];
+int __use_section_data irq_protect = 0;
+volatile int __use_section_data exiter_done = 0;
+volatile int __use_section_data holder_ok = 0;
+volatile int __use_section_data fresh_ok = 0;
+
+/* widest register xcr0 allows, zmm0 / ymm0 / xmm0 */
+static uint32_t vec_bytes(void)
+{
+	return (x86_xcr0 & XCR0_AVX512) ? 64 : (x86_xcr0 & XCR0_AVX) ? 32 : 16;
+}
+
+static void vec_load(const uint8_t *p)
+{
+	if (x86_xcr0 & XCR0_AVX512) {
+		__asm__ volatile ("vmovdqu64 (%0), %%zmm0" :: "r" (p) : "memory");
+	} else if (x86_xcr0 & XCR0_AVX) {
+		__asm__ volatile ("vmovdqu (%0), %%ymm0" :: "r" (p) : "memory");
+	} else {
+		__asm__ volatile ("movdqu (%0), %%xmm0" :: "r" (p) : "memory");
+	}
+}
+
+static void vec_store(uint8_t *p)
+{
+	if (x86_xcr0 & XCR0_AVX512) {
+		__asm__ volatile ("vmovdqu64 %%zmm0, (%0)" :: "r" (p) : "memory");
+	} else if (x86_xcr0 & XCR0_AVX) {
+		__asm__ volatile ("vmovdqu %%ymm0, (%0)" :: "r" (p) : "memory");
+	} else {
+		__asm__ volatile ("movdqu %%xmm0, (%0)" :: "r" (p) : "memory");
+	}
+}
+
+static int vec_check(const uint8_t *expect)
+{
+	vec_store(readback);
+	return memcmp(readback, expect, vec_bytes()) == 0;
+}
+
+/* an interrupt handler that uses the widest register */
+static void scribble_isr(isr_regs_t *regs __attribute__((unused)))
+{
+	if (irq_protect) {
+		fpu_begin();
+	}
+
+	vec_load(pattern[2]);
+
+	if (irq_protect) {
+		fpu_end();
+	}
+}
+
+static const char *result(int ok)
+{
+	return ok ? "ok" : "*** FAIL ***";
+}
+
+static void switch_test(void)
+{
+	int ok;
+
+	fpu_switch(&ctx[0]);
+	vec_load(pattern[0]);
+	fpu_switch(&ctx[1]);
+	vec_load(pattern[1]);
+
+	fpu_switch(&ctx[0]);
+	ok = vec_check(pattern[0]);
+	fpu_switch(&ctx[1]);
+	ok = vec_check(pattern[1]) && ok;
+
+	printf("switch: %u byte register kept across contexts: %s (%u #nm)\n",
+		vec_bytes(), result(ok), fpu_lazy_faults(0));
+}
+
+static void irq_test(void)
+{
+	fpu_switch(&ctx[0]);
+	vec_load(pattern[0]);
+
+	irq_protect = 0;
+	__asm__ volatile ("int %0" :: "i" (SCRIBBLE_VECTOR) : "memory");
+	printf("irq: unprotected handler, state %s\n",
+		vec_check(pattern[0]) ? "kept" : "clobbered, as expected");
+
+	vec_load(pattern[0]);
+	irq_protect = 1;
+	__asm__ volatile ("int %0" :: "i" (SCRIBBLE_VECTOR) : "memory");
+	printf("irq: fpu_begin/fpu_end handler: %s\n", result(vec_check(pattern[0])));
+}
+
+static void cost_test(void)
+{
+	uint64_t tsc;
+
+	tsc = rdtsc();
+	for (uint32_t i = 0; i < COST_ITERS; i++) {
+		fpu_save(ctx[0].area);
+		fpu_restore(ctx[0].area);
+	}
+	tsc = rdtsc() - tsc;
+	printf("cost: save + restore %u cycles\n", (uint32_t) div_u64(tsc, COST_ITERS));
+
+	tsc = rdtsc();
+	for (uint32_t i = 0; i < COST_ITERS; i++) {
+		fpu_switch(&ctx[i & 1]);
+		vec_load(pattern[i & 1]);
+	}
+	tsc = rdtsc() - tsc;
+	printf("cost: switch + first use %u cycles\n", (uint32_t) div_u64(tsc, COST_ITERS));
+}
+
+/* holds pattern 0 while preempted, across the exiter's death on this cpu */
+static void vec_holder(void *arg __attribute__((unused)))
+{
+	vec_load(pattern[0]);
+	while (!exiter_done) {
+		__asm__ volatile ("pause");
+	}
+
+	holder_ok = vec_check(pattern[0]);
+}
+
+static void vec_exiter(void *arg __attribute__((unused)))
+{
+	vec_load(pattern[1]);
+	exiter_done = 1;
+}
+
+/* reuses the exiter's slot, its registers start in init state */
+static void vec_fresh(void *arg __attribute__((unused)))
+{
+	fresh_ok = vec_check(zero);
+}
+
+static void thread_test(void)
+{
+	struct thread *holder, *exiter, *fresh;
+
+	sched_start(SLICE_US);
+	holder = thread_create(0, vec_holder, 0);
+	exiter = thread_create(0, vec_exiter, 0);
+	if (!holder || !exiter) {
+		printf("*** fpu: no memory for the threads ***\n");
+		return;
+	}
+
+	thread_join(exiter);
+	thread_join(holder);
+	printf("threads: preempted register kept across an exit: %s\n", result(holder_ok));
+
+	if (!(fresh = thread_create(0, vec_fresh, 0))) {
+		printf("*** fpu: no memory for the threads ***\n");
+		return;
+	}
+
+	thread_join(fresh);
+	printf("threads: recycled thread starts in init state: %s\n", result(fresh_ok));
+}
+
+void __entry startup32()
+{
+	uint32_t node;
+
+	cli();
+	x86_cpu_init();
+	apic_init();
+	sti();
+
+	puts("[fpu_test]: start\n");
+	printf("xcr0 0x%x (avx %u, avx-512 %u, amx %u), area %u bytes, %s, %s switch\n",
+		(uint32_t) x86_xcr0, !!(x86_xcr0 & XCR0_AVX),
+		(x86_xcr0 & XCR0_AVX512) == XCR0_AVX512, (x86_xcr0 & XCR0_AMX) == XCR0_AMX,
+		x86_xsave_size, !x86_xcr0 ? "fxsave" : x86_xsaveopt ? "xsaveopt" : "xsave",
+		fpu_lazy() ? "lazy" : "eager");
+
+	/* fpu_init, and the scheduler for thread_test (not started until then) */
+	if (sched_init() < 0) {
+		printf("*** fpu: sched_init failed ***\n");
+		__halt();
+	}
+
+	node = numa_node_of_cpu(apic_id());
+	if (fpu_ctx_init(&ctx[0], node) < 0 || fpu_ctx_init(&ctx[1], node) < 0) {
+		printf("*** fpu: no memory for the save areas ***\n");
+		__halt();
+	}
+
+	for (uint32_t i = 0; i < VEC_MAX; i++) {
+		pattern[0][i] = (uint8_t) (0x11 + i);
+		pattern[1][i] = (uint8_t) (0xa0 ^ i);
+		pattern[2][i] = 0xee;
+	}
+
+	idt_set_handler(SCRIBBLE_VECTOR, scribble_isr);
+
+	switch_test();
+	irq_test();
+	cost_test();
+	thread_test();
+
+	puts("[fpu_test]: end\n");
+	payload_done();
+}
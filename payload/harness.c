@@ -0,0 +1,230 @@
+/*
+ * harness.c - registered benchmarks: calibration, repetitions, statistics
+ *
+ * a repetition is one call of the benchmark with iters iterations,
+ * timed lfence/rdtsc/lfence to rdtscp/lfence. iters doubles until a
+ * repetition takes BENCH_TARGET_US, the empty interval's minimum is
+ * subtracted from every sample.
+ */
+
+#include "cpu.h"
+#include "video.h"
+#include "div64.h"
+#include "lapic.h"
+#include "harness.h"
+#include "results.h"
+#include "compiler.h"
+
+#define OVERHEAD_SAMPLES 1000
+
+extern const struct bench_entry __bench_start[] __hidden;
+extern const struct bench_entry __bench_end[] __hidden;
+
+uint32_t __use_section_data bench_rdtscp = 0;
+uint32_t __use_section_data bench_tsc_overhead = 0;
+uint32_t bench_samples[BENCH_REPS];
+
+static inline uint64_t tsc_begin(void)
+{
+	uint64_t t;
+
+	__asm__ volatile ("lfence" ::: "memory");
+	t = rdtsc();
+	__asm__ volatile ("lfence" ::: "memory");
+	return t;
+}
+
+/* rdtscp waits for the measured code, lfence keeps later code out */
+static inline uint64_t tsc_end(void)
+{
+	uint32_t low, high, aux;
+
+	if (bench_rdtscp) {
+		__asm__ volatile ("rdtscp" : "=a" (low), "=d" (high), "=c" (aux) :: "memory");
+	} else {
+		__asm__ volatile ("lfence; rdtsc" : "=a" (low), "=d" (high) :: "memory");
+	}
+	__asm__ volatile ("lfence" ::: "memory");
+	return ((uint64_t) high << 32) | low;
+}
+
+static void timing_init(void)
+{
+	uint32_t a = 0x80000000, b = 0, c = 0, d = 0;
+	uint64_t t, best = ~0ull;
+
+	__cpuid(&a, &b, &c, &d);
+	if (a >= 0x80000001) {
+		a = 0x80000001;
+		__cpuid(&a, &b, &c, &d);
+		bench_rdtscp = (d & CPUID_80000001_EDX_RDTSCP) != 0;
+	}
+
+	for (uint32_t i = 0; i < OVERHEAD_SAMPLES; i++) {
+		t = tsc_begin();
+		t = tsc_end() - t;
+		best = (t < best) ? t : best;
+	}
+
+	bench_tsc_overhead = (uint32_t) best;
+}
+
+uint32_t bench_count(void)
+{
+	return __bench_end - __bench_start;
+}
+
+const char *bench_name(uint32_t i)
+{
+	const struct bench_entry *e = &__bench_start[i];
+
+	return (const char *) &e->name + e->name;
+}
+
+bench_fn_t bench_fn(uint32_t i)
+{
+	const struct bench_entry *e = &__bench_start[i];
+
+	return (bench_fn_t) ((const char *) &e->fn + e->fn);
+}
+
+uint32_t bench_overhead(void)
+{
+	return bench_tsc_overhead;
+}
+
+static uint64_t time_once(bench_fn_t fn, uint32_t iters)
+{
+	uint64_t t = tsc_begin();
+
+	fn(iters);
+	t = tsc_end() - t;
+	return (t > bench_tsc_overhead) ? t - bench_tsc_overhead : 0;
+}
+
+static void sort(uint32_t *v, uint32_t n)
+{
+	uint32_t x, j;
+
+	for (uint32_t i = 1; i < n; i++) {
+		x = v[i];
+		for (j = i; j > 0 && v[j - 1] > x; j--) {
+			v[j] = v[j - 1];
+		}
+		v[j] = x;
+	}
+}
+
+static uint32_t isqrt(uint64_t v)
+{
+	uint64_t r = 0, bit = 1ull << 62;
+
+	while (bit > v) {
+		bit >>= 2;
+	}
+
+	for (; bit; bit >>= 2) {
+		if (v >= r + bit) {
+			v -= r + bit;
+			r = (r >> 1) + bit;
+		} else {
+			r >>= 1;
+		}
+	}
+
+	return (uint32_t) r;
+}
+
+static void stats(struct bench_result *r, uint32_t *v, uint32_t n)
+{
+	uint64_t sum = 0, var = 0;
+	int64_t d;
+
+	sort(v, n);
+	for (uint32_t i = 0; i < n; i++) {
+		sum += v[i];
+	}
+
+	r->min = v[0];
+	r->median = v[n / 2];
+	r->p99 = v[(n * 99 + 99) / 100 - 1];
+	r->mean = (uint32_t) div_u64(sum, n);
+
+	for (uint32_t i = 0; i < n; i++) {
+		d = (int64_t) v[i] - r->mean;
+		var += (uint64_t) (d * d);
+	}
+
+	r->stddev = isqrt(div_u64(var, n));
+}
+
+/* -1 for a bad index */
+int bench_run(uint32_t i, struct bench_result *r)
+{
+	uint64_t target, t;
+	uint32_t iters = 1;
+	bench_fn_t fn;
+
+	if (i >= bench_count()) {
+		return -1;
+	}
+
+	if (!bench_tsc_overhead) {
+		timing_init();
+	}
+
+	fn = bench_fn(i);
+	target = div_u64((uint64_t) apic_tsc_per_ms() * BENCH_TARGET_US, 1000);
+
+	/* calibration doubles as the first warmup */
+	while (time_once(fn, iters) < target && iters < BENCH_MAX_ITERS) {
+		iters <<= 1;
+	}
+
+	for (uint32_t rep = 0; rep < BENCH_WARMUP; rep++) {
+		time_once(fn, iters);
+	}
+
+	for (uint32_t rep = 0; rep < BENCH_REPS; rep++) {
+		t = div_u64(time_once(fn, iters) * 100, iters);
+		bench_samples[rep] = (t >> 32) ? 0xffffffff : (uint32_t) t;
+	}
+
+	r->iters = iters;
+	r->reps = BENCH_REPS;
+	stats(r, bench_samples, BENCH_REPS);
+	return 0;
+}
+
+/* one key=value line per benchmark, cycles per iteration, and a record
+ * in the results region when results_init() found one */
+void bench_run_all(void)
+{
+	struct bench_result r;
+	uint64_t v[7];
+
+	if (!bench_tsc_overhead) {
+		timing_init();
+	}
+
+	printf("bench: count=%u tsc_khz=%u overhead=%u rdtscp=%u\n", bench_count(),
+		apic_tsc_per_ms(), bench_tsc_overhead, bench_rdtscp);
+
+	for (uint32_t i = 0; i < bench_count(); i++) {
+		bench_run(i, &r);
+		printf("bench: name=%s iters=%u reps=%u min=%u.%02u median=%u.%02u "
+			"p99=%u.%02u mean=%u.%02u stddev=%u.%02u\n",
+			bench_name(i), r.iters, r.reps, r.min / 100, r.min % 100,
+			r.median / 100, r.median % 100, r.p99 / 100, r.p99 % 100,
+			r.mean / 100, r.mean % 100, r.stddev / 100, r.stddev % 100);
+
+		v[0] = r.iters;
+		v[1] = r.reps;
+		v[2] = r.min;
+		v[3] = r.median;
+		v[4] = r.p99;
+		v[5] = r.mean;
+		v[6] = r.stddev;
+		results_add(RESULTS_T_BENCH, bench_name(i), __apicid(), v, 7);
+	}
+}
@@ -0,0 +1,57 @@
+/*
+ * harness.h - registered benchmarks: calibration, repetitions, statistics
+ */
+
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include "inttypes.h"
+
+#define BENCH_TARGET_US  100     /* one repetition runs at least this long */
+#define BENCH_MAX_ITERS  (1 << 24)
+#define BENCH_WARMUP     10
+#define BENCH_REPS       101
+
+typedef void (*bench_fn_t)(uint32_t iters);
+
+/*
+ * no pointer tables, the image isn't relocated: each entry holds the
+ * function and name as offsets from the entry itself, resolved at link time
+ */
+struct bench_entry {
+	int32_t fn;
+	int32_t name;
+};
+
+/*
+ * BENCH(name) { for (uint32_t i = 0; i < iters; i++) ...; }
+ * the body runs the measured operation iters times, the harness picks
+ * iters. only objects linked into the image register (payload/benches).
+ */
+#define BENCH(name)                                                    \
+	static void __attribute__((used, noinline)) bench_##name(uint32_t iters); \
+	__asm__(".pushsection .bench,\"a\"\n"                              \
+		".balign 4\n"                                                  \
+		".long bench_" #name " - .\n"                                  \
+		".long 1f - .\n"                                               \
+		".pushsection .rodata\n"                                       \
+		"1: .asciz \"" #name "\"\n"                                    \
+		".popsection\n"                                                \
+		".popsection\n");                                              \
+	static void bench_##name(uint32_t iters)
+
+struct bench_result {
+	uint32_t iters;
+	uint32_t reps;
+	/* per iteration, cycles * 100, timing overhead subtracted */
+	uint32_t min, median, p99, mean, stddev;
+};
+
+uint32_t bench_count(void);
+const char *bench_name(uint32_t i);
+bench_fn_t bench_fn(uint32_t i);
+uint32_t bench_overhead(void);
+int bench_run(uint32_t i, struct bench_result *r);
+void bench_run_all(void);
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ * hist.c
+ */
+
+#include "div64.h"
+#include "string.h"
+#include "hist.h"
+
+void hist_reset(hist_t *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = 0xffffffff;
+}
+
+void hist_merge(hist_t *dst, const hist_t *src)
+{
+	for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+		dst->count[i] += src->count[i];
+	}
+
+	dst->min = (src->min < dst->min) ? src->min : dst->min;
+	dst->max = (src->max > dst->max) ? src->max : dst->max;
+	dst->n += src->n;
+}
+
+/* smallest value that lands in bucket */
+uint32_t hist_bucket_low(uint32_t bucket)
+{
+	uint32_t msb;
+
+	if (bucket < HIST_SUB) {
+		return bucket;
+	}
+
+	msb = (bucket >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+	return (HIST_SUB + (bucket & (HIST_SUB - 1))) << (msb - HIST_SUB_BITS);
+}
+
+/* lower bound of the bucket holding the ppm quantile, within [min, max] */
+uint32_t hist_quantile(const hist_t *h, uint32_t ppm)
+{
+	uint64_t rank, seen = 0;
+	uint32_t v;
+
+	if (!h->n) {
+		return 0;
+	}
+
+	if (ppm >= 1000000) {
+		return h->max;
+	}
+
+	rank = div_u64(h->n * ppm, 1000000) + 1;
+	for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->count[i];
+		if (seen >= rank) {
+			v = hist_bucket_low(i);
+			return (v < h->min) ? h->min : (v > h->max) ? h->max : v;
+		}
+	}
+
+	return h->max;
+}
@@ -0,0 +1,52 @@
+/*
+ * hist.h - log-linear histogram, 16 sub-buckets per power of two
+ */
+
+#ifndef HIST_H
+#define HIST_H
+
+#include "inttypes.h"
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS  ((32 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+/* quantiles in parts per million */
+#define HIST_P50      500000
+#define HIST_P99      990000
+#define HIST_P9999    999900
+
+typedef struct _hist {
+	uint64_t n;
+	uint32_t min, max;
+	uint32_t count[HIST_BUCKETS];
+} hist_t;
+
+/* exact below HIST_SUB * 2, ~6% wide buckets above */
+static inline uint32_t hist_bucket(uint32_t v)
+{
+	uint32_t msb;
+
+	if (v < HIST_SUB) {
+		return v;
+	}
+
+	msb = 31 - __builtin_clz(v);
+	return ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) +
+		((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+static inline void hist_add(hist_t *h, uint32_t v)
+{
+	h->count[hist_bucket(v)]++;
+	h->min = (v < h->min) ? v : h->min;
+	h->max = (v > h->max) ? v : h->max;
+	h->n++;
+}
+
+void hist_reset(hist_t *h);
+void hist_merge(hist_t *dst, const hist_t *src);
+uint32_t hist_bucket_low(uint32_t bucket);
+uint32_t hist_quantile(const hist_t *h, uint32_t ppm);
+
+#endif
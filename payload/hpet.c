@@ -0,0 +1,161 @@
+/*
+ * hpet.c - hpet main counter and fsb (msi) comparators
+ */
+
+#include "cpu.h"
+#include "acpi.h"
+#include "hpet.h"
+#include "div64.h"
+#include "lapic.h"
+#include "compiler.h"
+
+/* period is at most 100ns (hpet spec 2.3.9.2) */
+#define HPET_MAX_PERIOD 100000000
+
+uint32_t __use_section_data hpet_mmio = 0;
+uint32_t __use_section_data hpet_period = 0;   /* femtoseconds per tick */
+uint32_t __use_section_data hpet_per_ms = 0;
+int __use_section_data hpet_probed = 0;
+
+static inline uint32_t hpet_rd(uint32_t reg)
+{
+	return *(volatile uint32_t *) (uintptr_t) (hpet_mmio + reg);
+}
+
+static inline void hpet_wr(uint32_t reg, uint32_t val)
+{
+	*(volatile uint32_t *) (uintptr_t) (hpet_mmio + reg) = val;
+}
+
+/* found through the acpi hpet table, probed once (bsp first) */
+int hpet_init(void)
+{
+	const struct acpi_hpet *t;
+	uint32_t conf;
+
+	if (hpet_probed) {
+		return hpet_present() ? 0 : -1;
+	}
+
+	hpet_probed = 1;
+
+	t = (const struct acpi_hpet *) acpi_find_table("HPET", 0);
+	if (!t || t->hdr.length < sizeof(*t) || t->base.space_id != 0 ||
+		!t->base.address || (t->base.address >> 32)) {
+		return -1;
+	}
+
+	hpet_mmio = (uint32_t) t->base.address;
+	hpet_period = hpet_rd(HPET_GCAP_ID + 4);
+	if (!hpet_period || hpet_period > HPET_MAX_PERIOD) {
+		hpet_mmio = 0;
+		return -1;
+	}
+
+	hpet_per_ms = (uint32_t) div_u64(HPET_FS_PER_MS, hpet_period);
+
+	/* no legacy replacement, keep a running counter */
+	conf = hpet_rd(HPET_GEN_CONF) & ~HPET_CNF_LEG_RT;
+	if (!(conf & HPET_CNF_ENABLE)) {
+		hpet_wr(HPET_GEN_CONF, conf);
+		hpet_wr(HPET_MAIN_CNT, 0);
+		hpet_wr(HPET_MAIN_CNT + 4, 0);
+	}
+
+	hpet_wr(HPET_GEN_CONF, conf | HPET_CNF_ENABLE);
+	return 0;
+}
+
+int hpet_present(void)
+{
+	return hpet_mmio != 0;
+}
+
+uint32_t hpet_base(void)
+{
+	return hpet_mmio;
+}
+
+/* 64-bit counter in two reads, retried if the high half moved */
+uint64_t hpet_read(void)
+{
+	uint32_t high, low;
+
+	do {
+		high = hpet_rd(HPET_MAIN_CNT + 4);
+		low = hpet_rd(HPET_MAIN_CNT);
+	} while (high != hpet_rd(HPET_MAIN_CNT + 4));
+
+	return ((uint64_t) high << 32) | low;
+}
+
+uint32_t hpet_ticks_per_ms(void)
+{
+	return hpet_per_ms;
+}
+
+/* one mmio read per iteration, no port io */
+void hpet_wait_us(uint32_t usec)
+{
+	uint64_t ticks = div_u64((uint64_t) usec * 1000000000ull, hpet_period);
+	uint64_t start = hpet_read();
+
+	while (hpet_read() - start < ticks) {
+		__asm__ volatile ("pause");
+	}
+}
+
+uint32_t hpet_num_timers(void)
+{
+	return ((hpet_rd(HPET_GCAP_ID) >> 8) & 0x1f) + 1;
+}
+
+/*
+ * 32-bit comparator, delivered as an fsb message straight to the lapic of
+ * cpu (edge, fixed). -1 if the timer can't do fsb (or periodic) delivery.
+ */
+int hpet_timer_arm(uint8_t timer, uint8_t vector, uint8_t cpu, uint32_t ticks,
+	int periodic)
+{
+	uint32_t cap, conf;
+
+	if (!hpet_present() || timer >= hpet_num_timers() || !ticks) {
+		return -1;
+	}
+
+	cap = hpet_rd(HPET_TN_CONF(timer));
+	if (!(cap & HPET_TN_FSB_CAP) || (periodic && !(cap & HPET_TN_PER_CAP))) {
+		return -1;
+	}
+
+	hpet_timer_stop(timer);
+
+	/* fsb: data (vector), address (lapic of cpu) */
+	hpet_wr(HPET_TN_FSB(timer), vector);
+	hpet_wr(HPET_TN_FSB(timer) + 4, APICBASE | ((uint32_t) cpu << 12));
+
+	conf = (cap & ~(HPET_TN_INT_TYPE | HPET_TN_PERIODIC)) | HPET_TN_32MODE |
+		HPET_TN_FSB_EN | HPET_TN_INT_ENB;
+
+	if (periodic) {
+		/* first write sets the target, the second the period */
+		hpet_wr(HPET_TN_CONF(timer), conf | HPET_TN_PERIODIC | HPET_TN_VAL_SET);
+		hpet_wr(HPET_TN_CMP(timer), (uint32_t) hpet_read() + ticks);
+		hpet_wr(HPET_TN_CMP(timer), ticks);
+	} else {
+		hpet_wr(HPET_TN_CONF(timer), conf);
+		hpet_wr(HPET_TN_CMP(timer), (uint32_t) hpet_read() + ticks);
+	}
+
+	return 0;
+}
+
+void hpet_timer_stop(uint8_t timer)
+{
+	if (!hpet_present() || timer >= hpet_num_timers()) {
+		return;
+	}
+
+	hpet_wr(HPET_TN_CONF(timer), hpet_rd(HPET_TN_CONF(timer)) &
+		~(HPET_TN_INT_ENB | HPET_TN_PERIODIC));
+}
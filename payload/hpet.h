@@ -0,0 +1,47 @@
+/*
+ * hpet.h - high precision event timer
+ */
+
+#ifndef HPET_H
+#define HPET_H
+
+#include "inttypes.h"
+
+/* registers */
+#define HPET_GCAP_ID      0x000
+#define HPET_GEN_CONF     0x010
+#define HPET_GINTR_STA    0x020
+#define HPET_MAIN_CNT     0x0f0
+#define HPET_TN_CONF(n)   (0x100 + (n) * 0x20)
+#define HPET_TN_CMP(n)    (0x108 + (n) * 0x20)
+#define HPET_TN_FSB(n)    (0x110 + (n) * 0x20)
+
+/* general config */
+#define HPET_CNF_ENABLE   0x1
+#define HPET_CNF_LEG_RT   0x2
+
+/* timer config */
+#define HPET_TN_INT_TYPE  0x0002    /* level */
+#define HPET_TN_INT_ENB   0x0004
+#define HPET_TN_PERIODIC  0x0008
+#define HPET_TN_PER_CAP   0x0010
+#define HPET_TN_SIZE_CAP  0x0020    /* 64-bit comparator */
+#define HPET_TN_VAL_SET   0x0040
+#define HPET_TN_32MODE    0x0100
+#define HPET_TN_FSB_EN    0x4000
+#define HPET_TN_FSB_CAP   0x8000
+
+#define HPET_FS_PER_MS    1000000000000ull
+
+int hpet_init(void);
+int hpet_present(void);
+uint32_t hpet_base(void);
+uint64_t hpet_read(void);
+uint32_t hpet_ticks_per_ms(void);
+void hpet_wait_us(uint32_t usec);
+uint32_t hpet_num_timers(void);
+int hpet_timer_arm(uint8_t timer, uint8_t vector, uint8_t cpu, uint32_t ticks,
+	int periodic);
+void hpet_timer_stop(uint8_t timer);
+
+#endif
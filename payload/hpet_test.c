@@ -0,0 +1,95 @@
+/*
+ * hpet_test.c - hpet vs pit calibration, periodic comparator interrupts
+ */
+
+#include "cpu.h"
+#include "idt.h"
+#include "pit.h"
+#include "hpet.h"
+#include "video.h"
+#include "lapic.h"
+#include "compiler.h"
+
+#define HPET_VECTOR   0x41
+#define HPET_FIRES    10
+
+volatile uint32_t __use_section_data fires = 0;
+uint64_t fire_tsc[HPET_FIRES];
+
+static void __interrupt hpet_isr(isr_frame_t *frame __attribute__((unused)))
+{
+	if (fires < HPET_FIRES) {
+		fire_tsc[fires] = rdtsc();
+	}
+
+	fires++;
+	apic_eoi();
+}
+
+static uint32_t tsc_per_ms_pit(void)
+{
+	uint64_t tsc = rdtsc();
+	pit2_wait_msec(16);
+	return (uint32_t) ((rdtsc() - tsc) >> 4);
+}
+
+static uint32_t tsc_per_ms_hpet(void)
+{
+	uint64_t tsc = rdtsc();
+	hpet_wait_us(16000);
+	return (uint32_t) ((rdtsc() - tsc) >> 4);
+}
+
+static void periodic_test(void)
+{
+	uint8_t timer;
+
+	for (timer = 0; timer < hpet_num_timers(); timer++) {
+		if (hpet_timer_arm(timer, HPET_VECTOR, apic_id(), hpet_ticks_per_ms(), 1) == 0) {
+			break;
+		}
+	}
+
+	if (timer == hpet_num_timers()) {
+		puts("hpet: no timer with fsb + periodic delivery\n");
+		return;
+	}
+
+	while (fires < HPET_FIRES) {
+		__asm__ volatile ("hlt");
+	}
+
+	hpet_timer_stop(timer);
+
+	printf("hpet: timer %u, 1 ms periodic, tsc deltas:", timer);
+	for (uint32_t i = 1; i < HPET_FIRES; i++) {
+		printf(" %u", (uint32_t) (fire_tsc[i] - fire_tsc[i - 1]));
+	}
+	putchar('\n');
+}
+
+void __entry startup32()
+{
+	cli();
+	x86_cpu_init();
+	apic_init();
+	idt_set_gate(HPET_VECTOR, (void *) hpet_isr);
+	sti();
+
+	puts("[hpet_test]: start\n");
+
+	if (!hpet_present()) {
+		printf("hpet: not found, apic calibrated with the pit\n");
+		payload_done();
+	}
+
+	printf("hpet: base 0x%x, %u ticks/ms, %u timers\n", hpet_base(),
+		hpet_ticks_per_ms(), hpet_num_timers());
+	printf("tsc/ms: apic_init %u, pit %u, hpet %u\n", apic_tsc_per_ms(),
+		tsc_per_ms_pit(), tsc_per_ms_hpet());
+
+	periodic_test();
+
+	puts("[hpet_test]: end\n");
+	payload_done();
+}
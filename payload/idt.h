@@ -7,6 +7,10 @@
 
 #include "inttypes.h"
 
+#define IDT_NUMVECTORS 256
+#define IDT_STUB_SIZE  16   /* isr.S, stub n at isr_stubs + n * 16 */
+
+#ifndef __ASSEMBLY__
 typedef struct _isr_frame {
 #ifdef __x86_64__
 	uint64_t ip, cs, flags;
@@ -15,9 +19,31 @@ typedef struct _isr_frame {
 #endif
 } isr_frame_t;
 
+/* frame built by the isr.S stubs */
+#ifdef __x86_64__
+typedef struct _isr_regs {
+	uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+	uint64_t rdi, rsi, rbp, rbx, rdx, rcx, rax;
+	uint64_t vector, error;
+	uint64_t ip, cs, flags, sp, ss;
+} isr_regs_t;
+#else
+typedef struct _isr_regs {
+	uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax; /* pushal */
+	uint32_t vector, error;
+	uint32_t ip, cs, flags;
+} isr_regs_t;
+#endif
+
 typedef void (*isr_handler_t)(isr_frame_t *frame);
 
+/* table handlers run from the common stub, general registers only */
+typedef void (*idt_handler_t)(isr_regs_t *regs);
+
 void idt_init(void);
 void idt_set_gate(uint8_t num, void *isr);
+void idt_set_handler(uint8_t num, idt_handler_t handler);
+uint32_t idt_hits(uint8_t cpu, uint8_t num);
+#endif /* !__ASSEMBLY__ */
 
 #endif
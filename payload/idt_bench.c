@@ -0,0 +1,70 @@
+/*
+ * idt_bench.c - direct gate vs stub + table dispatch, cycles per int
+ */
+
+#include "cpu.h"
+#include "idt.h"
+#include "video.h"
+#include "div64.h"
+#include "lapic.h"
+#include "compiler.h"
+
+#define DIRECT_VECTOR 0x80
+#define TABLE_VECTOR  0x81
+
+#define BENCH_ITERS   100000
+#define BENCH_REPS    5
+
+#define __int(n) __asm__ volatile ("int %0" :: "i"(n) : "memory")
+
+static void __interrupt direct_isr(isr_frame_t *frame __attribute__((unused)))
+{
+}
+
+static void table_isr(isr_regs_t *regs __attribute__((unused)))
+{
+}
+
+/* best of BENCH_REPS, cycles for BENCH_ITERS software ints */
+#define BENCH_LOOP(best, body) do {                \
+	uint64_t __t;                                  \
+	best = ~0ull;                                  \
+	for (int __r = 0; __r < BENCH_REPS; __r++) {   \
+		__t = rdtsc();                             \
+		for (int __i = 0; __i < BENCH_ITERS; __i++) { \
+			body;                                  \
+		}                                          \
+		__t = rdtsc() - __t;                       \
+		best = (__t < best) ? __t : best;          \
+	}                                              \
+} while (0)
+
+void __entry startup32()
+{
+	uint64_t empty, direct, table;
+	uint32_t d, t;
+
+	cli();
+	x86_cpu_init();
+
+	idt_set_gate(DIRECT_VECTOR, (void *) direct_isr);
+	idt_set_handler(TABLE_VECTOR, table_isr);
+
+	puts("[idt_bench]: start\n");
+
+	BENCH_LOOP(empty, __asm__ volatile ("" ::: "memory"));
+	BENCH_LOOP(direct, __int(DIRECT_VECTOR));
+	BENCH_LOOP(table, __int(TABLE_VECTOR));
+
+	d = (uint32_t) div_u64(direct - empty, BENCH_ITERS);
+	t = (uint32_t) div_u64(table - empty, BENCH_ITERS);
+
+	printf("direct gate   : %6u cycles/int\n", d);
+	printf("stub + table  : %6u cycles/int\n", t);
+	printf("dispatch cost : %6d cycles/int\n", (int) (t - d));
+	printf("hits (cpu %u, vector 0x%x): %u\n", apic_id(), TABLE_VECTOR,
+		idt_hits(apic_id(), TABLE_VECTOR));
+
+	puts("[idt_bench]: end\n");
+	payload_done();
+}
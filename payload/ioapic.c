@@ -0,0 +1,252 @@
+/*
+ * ioapic.c - i/o apic, found through the madt
+ */
+
+#include "cpu.h"
+#include "acpi.h"
+#include "ioapic.h"
+#include "spinlock.h"
+#include "compiler.h"
+
+#define IOREGSEL 0x00
+#define IOWIN    0x10
+
+/* mps inti flags (madt interrupt source override) */
+#define INTI_POLARITY_MASK 0x3
+#define INTI_ACTIVE_LOW    0x3
+#define INTI_TRIGGER_MASK  0xc
+#define INTI_LEVEL         0xc
+
+struct ioapic {
+	uint32_t base;
+	uint32_t gsi_base;
+	uint32_t npins;
+};
+
+struct ioapic ioapics[ACPI_MAXIOAPIC];
+uint32_t __use_section_data nioapics = 0;
+
+/* ioregsel/iowin pairs are shared by all cpus */
+volatile uint32_t __use_section_data ioapic_lock = 0;
+
+static inline void lock(void)
+{
+	spin_lock(&ioapic_lock);
+}
+
+static inline void unlock(void)
+{
+	spin_unlock(&ioapic_lock);
+}
+
+static inline uint32_t io_read(const struct ioapic *io, uint32_t reg)
+{
+	*(volatile uint32_t *) (uintptr_t) (io->base + IOREGSEL) = reg;
+	return *(volatile uint32_t *) (uintptr_t) (io->base + IOWIN);
+}
+
+static inline void io_write(const struct ioapic *io, uint32_t reg, uint32_t val)
+{
+	*(volatile uint32_t *) (uintptr_t) (io->base + IOREGSEL) = reg;
+	*(volatile uint32_t *) (uintptr_t) (io->base + IOWIN) = val;
+}
+
+static struct ioapic *gsi_ioapic(uint32_t gsi, uint32_t *pin)
+{
+	for (uint32_t i = 0; i < nioapics; i++) {
+		if (gsi >= ioapics[i].gsi_base && gsi - ioapics[i].gsi_base < ioapics[i].npins) {
+			*pin = gsi - ioapics[i].gsi_base;
+			return &ioapics[i];
+		}
+	}
+
+	return 0;
+}
+
+static void ioapic_add(uint32_t base, uint32_t gsi_base)
+{
+	struct ioapic *io = &ioapics[nioapics];
+
+	io->base = base;
+	io->gsi_base = gsi_base;
+	io->npins = ((io_read(io, IOAPIC_VER) >> 16) & 0xff) + 1;
+
+	/* everything masked until routed */
+	for (uint32_t pin = 0; pin < io->npins; pin++) {
+		io_write(io, IOAPIC_REDTBL + pin * 2, IOAPIC_RTE_MASKED);
+		io_write(io, IOAPIC_REDTBL + pin * 2 + 1, 0);
+	}
+
+	nioapics++;
+}
+
+/* bsp, once. without a madt, one ioapic at the default address */
+int ioapic_init(void)
+{
+	if (nioapics) {
+		return 0;
+	}
+
+	if (!acpi.nioapic) {
+		acpi_init();
+	}
+
+	for (uint32_t i = 0; i < acpi.nioapic; i++) {
+		ioapic_add(acpi.ioapic[i].addr, acpi.ioapic[i].gsi_base);
+	}
+
+	if (!nioapics) {
+		ioapic_add(IOAPIC_DEFAULT_BASE, 0);
+	}
+
+	return 0;
+}
+
+uint32_t ioapic_num_gsi(void)
+{
+	uint32_t n = 0;
+
+	for (uint32_t i = 0; i < nioapics; i++) {
+		if (ioapics[i].gsi_base + ioapics[i].npins > n) {
+			n = ioapics[i].gsi_base + ioapics[i].npins;
+		}
+	}
+
+	return n;
+}
+
+/* isa irq to gsi, with the override's polarity and trigger */
+uint32_t ioapic_isa_gsi(uint8_t irq, uint32_t *flags)
+{
+	*flags = IOAPIC_EDGE_HIGH;
+
+	for (uint32_t i = 0; i < acpi.niso; i++) {
+		if (acpi.iso[i].bus != 0 || acpi.iso[i].source != irq) {
+			continue;
+		}
+
+		if ((acpi.iso[i].flags & INTI_POLARITY_MASK) == INTI_ACTIVE_LOW) {
+			*flags |= IOAPIC_ACTIVE_LOW;
+		}
+
+		if ((acpi.iso[i].flags & INTI_TRIGGER_MASK) == INTI_LEVEL) {
+			*flags |= IOAPIC_LEVEL;
+		}
+
+		return acpi.iso[i].gsi;
+	}
+
+	return irq;
+}
+
+/* fixed delivery, physical destination (apic id) */
+int ioapic_route_gsi(uint32_t gsi, uint8_t vector, uint8_t cpu, uint32_t flags)
+{
+	struct ioapic *io;
+	uint32_t pin;
+
+	if (vector < 0x10 || !(io = gsi_ioapic(gsi, &pin))) {
+		return -1;
+	}
+
+	lock();
+	io_write(io, IOAPIC_REDTBL + pin * 2, IOAPIC_RTE_MASKED);
+	io_write(io, IOAPIC_REDTBL + pin * 2 + 1, (uint32_t) cpu << 24);
+	io_write(io, IOAPIC_REDTBL + pin * 2, vector |
+		(flags & (IOAPIC_RTE_LOW | IOAPIC_RTE_LEVEL)));
+	unlock();
+
+	return 0;
+}
+
+int ioapic_route_isa(uint8_t irq, uint8_t vector, uint8_t cpu)
+{
+	uint32_t flags, gsi = ioapic_isa_gsi(irq, &flags);
+	return ioapic_route_gsi(gsi, vector, cpu, flags);
+}
+
+/*
+ * retarget at runtime: masked while the destination changes, an edge that
+ * arrives meanwhile is kept pending (irr) and delivered to the new cpu.
+ */
+int ioapic_set_dest(uint32_t gsi, uint8_t cpu)
+{
+	struct ioapic *io;
+	uint32_t pin, low;
+
+	if (!(io = gsi_ioapic(gsi, &pin))) {
+		return -1;
+	}
+
+	lock();
+	low = io_read(io, IOAPIC_REDTBL + pin * 2);
+	io_write(io, IOAPIC_REDTBL + pin * 2, low | IOAPIC_RTE_MASKED);
+	io_write(io, IOAPIC_REDTBL + pin * 2 + 1, (uint32_t) cpu << 24);
+	io_write(io, IOAPIC_REDTBL + pin * 2, low);
+	unlock();
+
+	return 0;
+}
+
+/* apic id the gsi is delivered to, -1 if unknown */
+int ioapic_dest(uint32_t gsi)
+{
+	struct ioapic *io;
+	uint32_t pin, high;
+
+	if (!(io = gsi_ioapic(gsi, &pin))) {
+		return -1;
+	}
+
+	lock();
+	high = io_read(io, IOAPIC_REDTBL + pin * 2 + 1);
+	unlock();
+
+	return high >> 24;
+}
+
+static int set_mask(uint32_t gsi, int masked)
+{
+	struct ioapic *io;
+	uint32_t pin, low;
+
+	if (!(io = gsi_ioapic(gsi, &pin))) {
+		return -1;
+	}
+
+	lock();
+	low = io_read(io, IOAPIC_REDTBL + pin * 2);
+	low = masked ? (low | IOAPIC_RTE_MASKED) : (low & ~IOAPIC_RTE_MASKED);
+	io_write(io, IOAPIC_REDTBL + pin * 2, low);
+	unlock();
+
+	return 0;
+}
+
+int ioapic_mask(uint32_t gsi)
+{
+	return set_mask(gsi, 1);
+}
+
+int ioapic_unmask(uint32_t gsi)
+{
+	return set_mask(gsi, 0);
+}
+
+/* every routed (unmasked) gsi to one housekeeping cpu */
+void ioapic_steer_all(uint8_t cpu)
+{
+	uint32_t low;
+
+	for (uint32_t i = 0; i < nioapics; i++) {
+		for (uint32_t pin = 0; pin < ioapics[i].npins; pin++) {
+			lock();
+			low = io_read(&ioapics[i], IOAPIC_REDTBL + pin * 2);
+			unlock();
+
+			if (!(low & IOAPIC_RTE_MASKED)) {
+				ioapic_set_dest(ioapics[i].gsi_base + pin, cpu);
+			}
+		}
+	}
+}
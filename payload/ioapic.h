@@ -0,0 +1,38 @@
+/*
+ * ioapic.h - i/o apic redirection
+ */
+
+#ifndef IOAPIC_H
+#define IOAPIC_H
+
+#include "inttypes.h"
+
+#define IOAPIC_DEFAULT_BASE 0xfec00000
+
+/* registers (indirect, ioregsel/iowin) */
+#define IOAPIC_ID      0x00
+#define IOAPIC_VER     0x01
+#define IOAPIC_REDTBL  0x10   /* + 2 * pin, low then high dword */
+
+/* redirection entry, low dword */
+#define IOAPIC_RTE_LOW     0x00002000   /* active low */
+#define IOAPIC_RTE_LEVEL   0x00008000
+#define IOAPIC_RTE_MASKED  0x00010000
+
+/* ioapic_route_gsi flags */
+#define IOAPIC_EDGE_HIGH   0
+#define IOAPIC_ACTIVE_LOW  IOAPIC_RTE_LOW
+#define IOAPIC_LEVEL       IOAPIC_RTE_LEVEL
+
+int ioapic_init(void);
+uint32_t ioapic_num_gsi(void);
+uint32_t ioapic_isa_gsi(uint8_t irq, uint32_t *flags);
+int ioapic_route_gsi(uint32_t gsi, uint8_t vector, uint8_t cpu, uint32_t flags);
+int ioapic_route_isa(uint8_t irq, uint8_t vector, uint8_t cpu);
+int ioapic_set_dest(uint32_t gsi, uint8_t cpu);
+int ioapic_mask(uint32_t gsi);
+int ioapic_unmask(uint32_t gsi);
+void ioapic_steer_all(uint8_t cpu);
+int ioapic_dest(uint32_t gsi);
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * ioapic_test.c - pit channel 0 through the ioapic, retargeted across cpus
+ */
+
+#include "cpu.h"
+#include "entry.h"
+#include "pit.h"
+#include "idt.h"
+#include "video.h"
+#include "format.h"
+#include "lapic.h"
+#include "ioapic.h"
+#include "compiler.h"
+
+#define PIT_VECTOR    0x50
+#define PIT_HZ_DIV    1193     /* ~1 kHz */
+#define PHASE_MS      200
+
+PAYLOAD_STACKS(4096);
+volatile uint32_t ticks[MAXCPU];
+
+static void __interrupt pit_isr(isr_frame_t *frame __attribute__((unused)))
+{
+	ticks[apic_id()]++;
+	apic_eoi();
+}
+
+/* tsc based, hlt would return on every pit tick */
+static void wait_ms(uint32_t msec)
+{
+	uint64_t end = rdtsc() + (uint64_t) msec * apic_tsc_per_ms();
+
+	while (rdtsc() < end) {
+		__asm__ volatile ("pause");
+	}
+}
+
+static void print_ticks(const char *what)
+{
+	printf("%-14s", what);
+	for (uint8_t cpu = 0; cpu < MAXCPU; cpu++) {
+		printf(" cpu%u=%-5u", cpu, ticks[cpu]);
+		ticks[cpu] = 0;
+	}
+	putchar('\n');
+}
+
+void __entry startup32()
+{
+	uint8_t apicid = __apicid();
+	uint32_t flags, gsi;
+	char label[16];
+
+	x86_basic_init(0);
+
+	/* aps only take interrupts */
+	if (apicid != 0) {
+		__halt();
+	}
+
+	puts("[ioapic_test]: start\n");
+	ioapic_init();
+	idt_set_gate(PIT_VECTOR, (void *) pit_isr);
+
+	for (uint8_t i = 1; i < MAXCPU; i++) {
+		apic_init_thread(i, startup32);
+		apic_timer_wait_ms(100);
+	}
+
+	gsi = ioapic_isa_gsi(0, &flags);
+	printf("ioapic: %u gsis, isa irq 0 -> gsi %u (flags 0x%x)\n", ioapic_num_gsi(),
+		gsi, flags);
+
+	if (ioapic_route_isa(0, PIT_VECTOR, 0) < 0) {
+		printf("*** ioapic: can't route gsi %u ***\n", gsi);
+		__halt();
+	}
+
+	pit_write(0, PIT_MODE_2, PIT_HZ_DIV);
+
+	/* round robin */
+	for (uint8_t cpu = 0; cpu < MAXCPU; cpu++) {
+		ioapic_set_dest(gsi, cpu);
+		wait_ms(PHASE_MS);
+		snprintf(label, sizeof(label), "dest cpu %u:", ioapic_dest(gsi));
+		print_ticks(label);
+	}
+
+	/* everything to the housekeeping cpu, the others stay quiet */
+	ioapic_steer_all(0);
+	wait_ms(PHASE_MS);
+	print_ticks("housekeeping:");
+
+	ioapic_mask(gsi);
+	puts("[ioapic_test]: end\n");
+	payload_done();
+}
@@ -0,0 +1,170 @@
+/*
+ * irq_latency.c - lapic timer interrupt latency (entry tsc - target tsc)
+ */
+
+#include "cpu.h"
+#include "entry.h"
+#include "idt.h"
+#include "hist.h"
+#include "video.h"
+#include "div64.h"
+#include "lapic.h"
+#include "string.h"
+#include "compiler.h"
+
+#define LAT_VECTOR     0x40
+#define LAT_SAMPLES    1000000
+#define LAT_MIN_DELAY  10000  /* tsc cycles from arming to target */
+#define LAT_DELAY_MASK 0x3fff /* plus a random part, avoids phase locking */
+
+/* per cpu memory load buffers, paging stays off */
+#define LOAD_BASE      0x1000000
+#define LOAD_SIZE      0x400000
+#define LOAD_CHUNK     0x10000
+
+enum {
+	LAT_IDLE,    /* hlt until the interrupt */
+	LAT_LOADED,  /* streaming copies until the interrupt */
+	LAT_NUMPHASES
+};
+
+struct lat_cpu {
+	volatile uint64_t entry;
+	volatile uint32_t fired;
+	volatile uint32_t done;
+	uint32_t early[LAT_NUMPHASES];
+	hist_t hist[LAT_NUMPHASES];
+} __align(64);
+
+PAYLOAD_STACKS(4096);
+struct lat_cpu lat[MAXCPU];
+
+static const char phase_name[LAT_NUMPHASES][8] = { "idle", "loaded" };
+
+/* first thing on entry: the tsc */
+static void __interrupt lat_timer_isr(isr_frame_t *frame __attribute__((unused)))
+{
+	uint64_t now = rdtsc();
+	struct lat_cpu *c = &lat[apic_id()];
+
+	c->entry = now;
+	c->fired = 1;
+	apic_eoi();
+}
+
+static inline uint32_t xorshift32(uint32_t x)
+{
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+static void lat_run(struct lat_cpu *c, uint8_t cpu, int phase, int deadline)
+{
+	uint32_t ticks_per_ms = apic_timer_ticks_per_ms();
+	uint32_t tsc_per_ms = apic_tsc_per_ms();
+	uint8_t *src = (uint8_t *) (LOAD_BASE + cpu * 2 * LOAD_SIZE);
+	uint8_t *dst = src + LOAD_SIZE;
+	uint32_t seed = 0x9e3779b9 ^ cpu, delay, ticks, off = 0;
+	uint64_t target;
+	int64_t diff;
+
+	hist_reset(&c->hist[phase]);
+	c->early[phase] = 0;
+
+	for (uint32_t i = 0; i < LAT_SAMPLES; i++) {
+		seed = xorshift32(seed);
+		delay = LAT_MIN_DELAY + (seed & LAT_DELAY_MASK);
+		c->fired = 0;
+
+		if (deadline) {
+			target = rdtsc() + delay;
+			apic_timer_arm_deadline(LAT_VECTOR, target);
+		} else {
+			/* target from the rounded tick count */
+			ticks = (uint32_t) div_u64((uint64_t) delay * ticks_per_ms, tsc_per_ms);
+			target = rdtsc() + div_u64((uint64_t) ticks * tsc_per_ms, ticks_per_ms);
+			apic_timer_arm_oneshot(LAT_VECTOR, ticks);
+		}
+
+		if (phase == LAT_IDLE) {
+			/* sti; hlt can't miss the wakeup */
+			cli();
+			while (!c->fired) {
+				__asm__ volatile ("sti; hlt; cli" ::: "memory");
+			}
+			sti();
+		} else {
+			while (!c->fired) {
+				memcpy(dst + off, src + off, LOAD_CHUNK);
+				off = (off + LOAD_CHUNK) & (LOAD_SIZE - 1);
+			}
+		}
+
+		diff = (int64_t) (c->entry - target);
+		if (diff < 0) {
+			c->early[phase]++;
+			diff = 0;
+		}
+
+		hist_add(&c->hist[phase], (diff >> 32) ? 0xffffffff : (uint32_t) diff);
+	}
+}
+
+static void lat_report(int deadline)
+{
+	hist_t *h;
+
+	printf("timer: %s, tsc %u kHz, %u samples/phase\n",
+		deadline ? "tsc-deadline" : "one-shot", apic_tsc_per_ms(), LAT_SAMPLES);
+	printf("cpu phase       min     p50     p99  p99.99       max  early\n");
+
+	for (uint8_t cpu = 0; cpu < MAXCPU; cpu++) {
+		for (int phase = 0; phase < LAT_NUMPHASES; phase++) {
+			h = &lat[cpu].hist[phase];
+			printf("%3u %-6s %7u %7u %7u %7u %9u %6u\n", cpu, phase_name[phase],
+				h->min, hist_quantile(h, HIST_P50), hist_quantile(h, HIST_P99),
+				hist_quantile(h, HIST_P9999), h->max, lat[cpu].early[phase]);
+		}
+	}
+}
+
+void __entry startup32()
+{
+	uint8_t apicid = __apicid();
+	int deadline;
+
+	x86_basic_init(0);
+
+	if (apicid == 0) {
+		puts("[irq_latency]: start\n");
+
+		/* set once, the idt is shared */
+		idt_set_gate(LAT_VECTOR, (void *) lat_timer_isr);
+		for (uint8_t i = 1; i < MAXCPU; i++) {
+			apic_init_thread(i, startup32);
+			apic_timer_wait_ms(100);
+		}
+	}
+
+	deadline = apic_timer_has_tsc_deadline();
+	for (int phase = 0; phase < LAT_NUMPHASES; phase++) {
+		lat_run(&lat[apicid], apicid, phase, deadline);
+	}
+
+	lat[apicid].done = 1;
+	if (apicid != 0) {
+		__halt();
+	}
+
+	for (uint8_t i = 0; i < MAXCPU; i++) {
+		while (!lat[i].done) {
+			__asm__ volatile ("pause");
+		}
+	}
+
+	lat_report(deadline);
+	puts("[irq_latency]: end\n");
+	payload_done();
+}
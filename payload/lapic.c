@@ -7,14 +7,22 @@
 #include "pit.h"
 #include "cpu.h"
 #include "boot.h"
+#include "hpet.h"
 #include "video.h"
 #include "string.h"
+#include "boottrace.h"
 #include "compiler.h"
 #include "lapic.h"
 
 /* ap trampoline */
 #define APTRAMPOLINE 0x8000
 
+#ifdef __x86_64__
+/* from long.S */
+extern const char long_start[] __hidden;
+extern volatile uint32_t long_entry64 __hidden;
+#endif
+
 /* APIC BASE MSR */
 #define IA32_APIC_BASE          0x1b
 #define APIC_BASE_BSP           0x100 /* Intel RW, AMD R Only */
@@ -250,16 +258,19 @@
 /* timer handlers (per cpu) */
 //timer_handler_t __use_section_data __align(16) apic_percpu_timer[MAXCPU] = { 0 };
 uint32_t __use_section_data __align(16) pcpu_ticks_per_ms[MAXCPU] = { 0 };
+uint32_t __use_section_data __align(16) pcpu_tsc_per_ms[MAXCPU] = { 0 };
+
+#define IA32_TSC_DEADLINE 0x6e0
 
 static inline void write_apic_u32(uint32_t off, uint32_t val)
 {
-	uint32_t *vptr = (uint32_t *) (APICBASE + off);
+	uint32_t *vptr = (uint32_t *) (uintptr_t) (APICBASE + off);
 	*vptr = val;
 }
 
 static inline uint32_t read_apic_u32(uint32_t off)
 {
-	uint32_t *vptr = (uint32_t *) (APICBASE + off);
+	uint32_t *vptr = (uint32_t *) (uintptr_t) (APICBASE + off);
 	return *vptr;
 }
 
@@ -289,25 +300,47 @@ static inline void apic_timer_reset(uint32_t mode, uint32_t value)
 	write_apic_u32(APIC_TIMER_DIV, 3);
 }
 
+/* hpet when present, pit channel 2 otherwise */
+static void calibration_wait_16ms(int hpet)
+{
+	if (hpet) {
+		hpet_wait_us(16000);
+	} else {
+		pit2_wait_msec(16);
+	}
+}
+
 static void apic_timer_init()
 {
 	uint32_t ticks_per_ms = 0;
+	uint64_t tsc;
+	int hpet;
 
 	/* set common handle */
 	idt_set_gate(APIC_TIMER_IRQ, (void *) apic_timer_irq);
 
-	/* calibrate (get ticks per us) */
+	/* acpi scan and hpet enable stay out of the window */
+	hpet = hpet_init() == 0;
+
+	/* calibrate (get ticks per us), tsc over the same window */
+	boot_stage(BOOT_STAGE_CALIBRATE);
 	apic_timer_reset(APIC_TIMER_ONESHOT, 0xffffffff);
-	pit2_wait_msec(16);
+	tsc = rdtsc();
+	calibration_wait_16ms(hpet);
 	ticks_per_ms = 0xffffffff - read_apic_u32(APIC_TIMER_CNT);
+	tsc = rdtsc() - tsc;
+	boot_stage(BOOT_STAGE_CALIBRATE_END);
 	ticks_per_ms >>= 4;
 
 	write_apic_u32(APIC_LVT_TIMER, APIC_LVT_MASK);
 	pcpu_ticks_per_ms[__apicid()] = ticks_per_ms;
+	pcpu_tsc_per_ms[__apicid()] = (uint32_t) (tsc >> 4);
 }
 
 void apic_init()
 {
+	boot_stage(BOOT_STAGE_APIC_INIT);
+
 	if (apic_present() == 0) {
 		puts("*** apic not present ***\n");
 		__halt();
@@ -344,6 +377,8 @@ void apic_init()
 	__wrmsr(IA32_APIC_BASE, __rdmsr(IA32_APIC_BASE) | APIC_BASE_APIC_ENABLE);
 	__wrmsr(IA32_APIC_BASE, __rdmsr(IA32_APIC_BASE) & ~APIC_BASE_x2APIC_ENABLE);
 	__wrmsr(IA32_APIC_BASE, (__rdmsr(IA32_APIC_BASE) & 0x00000fff) | 0xfee00000);
+
+	boot_stage(BOOT_STAGE_APIC_INIT_END);
 }
 
 void apic_timer_wait_ms(uint32_t msec)
@@ -360,6 +395,75 @@ void apic_timer_wait_ms(uint32_t msec)
 	__asm__ volatile("hlt");
 }
 
+void apic_eoi(void)
+{
+	write_apic_u32(APIC_EOI, 0);
+}
+
+uint32_t apic_timer_ticks_per_ms(void)
+{
+	return pcpu_ticks_per_ms[__apicid()];
+}
+
+uint32_t apic_tsc_per_ms(void)
+{
+	return pcpu_tsc_per_ms[__apicid()];
+}
+
+int apic_timer_has_tsc_deadline(void)
+{
+	uint32_t a = 1, b = 0, c = 0, d = 0;
+	__cpuid(&a, &b, &c, &d);
+	return (c & CPUID_1_ECX_TSC_DEADLINE) != 0;
+}
+
+/* one-shot, counts apic ticks (divide by 16, as calibrated) */
+void apic_timer_arm_oneshot(uint8_t vector, uint32_t ticks)
+{
+	write_apic_u32(APIC_LVT_TIMER, vector | APIC_TIMER_ONESHOT);
+	write_apic_u32(APIC_TIMER_DIV, 3);
+	write_apic_u32(APIC_TIMER_INI, ticks);
+}
+
+/* previous task priority, 0xff holds off every fixed vector */
+uint8_t apic_set_tpr(uint8_t tpr)
+{
+	uint8_t old = (uint8_t) read_apic_u32(APIC_TPR);
+
+	write_apic_u32(APIC_TPR, tpr);
+	return old;
+}
+
+/* pic interrupts through lint0 (ExtINT), masked again on 0 */
+void apic_extint(int enable)
+{
+	write_apic_u32(APIC_LVT_LINT0, enable ? 0x700 : APIC_LVT_MASK);
+}
+
+/* every ticks apic ticks until re-armed or reset */
+void apic_timer_arm_periodic(uint8_t vector, uint32_t ticks)
+{
+	write_apic_u32(APIC_LVT_TIMER, vector | APIC_TIMER_PERIODIC);
+	write_apic_u32(APIC_TIMER_DIV, 3);
+	write_apic_u32(APIC_TIMER_INI, ticks);
+}
+
+/* fires when the tsc reaches deadline */
+void apic_timer_arm_deadline(uint8_t vector, uint64_t deadline)
+{
+	write_apic_u32(APIC_LVT_TIMER, vector | APIC_TIMER_TSC);
+
+	/* order the lvt write before the msr write (sdm 10.5.4.1) */
+	__asm__ volatile ("mfence" ::: "memory");
+	__wrmsr(IA32_TSC_DEADLINE, deadline);
+}
+
+/* pmu overflow as nmi, the cpu masks the entry on each pmi */
+void apic_pmi_unmask(void)
+{
+	write_apic_u32(APIC_LVT_PERFC, 0x400);
+}
+
 static int ipi_mode_valid(uint32_t mode)
 {
 	switch (mode) {
@@ -421,8 +525,16 @@ void apic_send_ipi(uint8_t id, uint32_t shorthand, uint32_t mode, uint8_t vector
 void apic_init_thread(uint8_t id, void (*startup32)(void))
 {
 	uint32_t *apmem_startup32 = (uint32_t *)(APTRAMPOLINE + STARTUP32_OFFSET);
+
+#ifdef __x86_64__
+	/* the ap comes up in 32-bit code, long.S takes it to startup32 */
+	long_entry64 = (uint32_t) (uintptr_t) startup32;
+	*apmem_startup32 = (uint32_t) (uintptr_t) long_start;
+#else
 	*apmem_startup32 = (uint32_t) startup32;
+#endif
 
+	boot_stage_cpu(id, BOOT_STAGE_SIPI);
 	apic_send_ipi(id, 0, IPI_MODE_INIT, 0);
 	apic_send_ipi(id, 0, IPI_MODE_STARTUP, (APTRAMPOLINE >> 12));
 }
@@ -21,8 +21,24 @@
 #define IPI_ALL          0x80000 /* all, including self */
 #define IPI_OTHERS       0xC0000 /* all, excluding self */
 
+/* cheaper than cpuid, needs the apic mapped */
+static inline uint8_t apic_id(void)
+{
+	return (*(volatile uint32_t *) (APICBASE + 0x20)) >> 24;
+}
+
 void apic_init();
+void apic_eoi(void);
 void apic_timer_wait_ms(uint32_t msec);
+uint32_t apic_timer_ticks_per_ms(void);
+uint32_t apic_tsc_per_ms(void);
+int apic_timer_has_tsc_deadline(void);
+void apic_timer_arm_oneshot(uint8_t vector, uint32_t ticks);
+void apic_timer_arm_periodic(uint8_t vector, uint32_t ticks);
+void apic_timer_arm_deadline(uint8_t vector, uint64_t deadline);
+void apic_pmi_unmask(void);
+uint8_t apic_set_tpr(uint8_t tpr);
+void apic_extint(int enable);
 void apic_send_ipi(uint8_t id, uint32_t shorthand, uint32_t mode, uint8_t vector);
 void apic_init_thread(uint8_t id, void (*startup32)(void));
 
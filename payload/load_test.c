@@ -0,0 +1,94 @@
+/*
+ * load_test.c - load and unpack time of this image, raw or lz4
+ *
+ * LOAD_TEST_KB of generated data stands in for a benchmark's dataset:
+ * the first half a smooth table (compresses), the second half lcg noise
+ * (doesn't). make LOAD_TEST_KB=n and bminstall with or without -z give
+ * the sizes to compare; the data is checked against a regenerated copy.
+ * The aps come up as well, then the whole boot stage table is printed.
+ */
+
+#include "cpu.h"
+#include "entry.h"
+#include "boot.h"
+#include "video.h"
+#include "lapic.h"
+#include "paging.h"
+#include "compiler.h"
+#include "boottrace.h"
+
+#ifndef LOAD_TEST_KB
+#define LOAD_TEST_KB 64
+#endif
+
+#define DATA_HALF  (LOAD_TEST_KB * 512)
+#define XSTR(x)    __STR(x)
+
+PAYLOAD_STACKS(1024);
+volatile uint32_t __use_section_data cpus_up = 1;
+
+extern const uint8_t load_test_data[] __hidden;
+
+__asm__(
+	".section .data\n"
+	".balign 64\n"
+	"load_test_data:\n"
+	".set i, 0\n"
+	".rept " XSTR(DATA_HALF) "\n"
+	".byte ((i >> 3) ^ (i >> 9)) & 0xff\n"
+	".set i, i + 1\n"
+	".endr\n"
+	".set seed, 1\n"
+	".rept " XSTR(DATA_HALF) "\n"
+	".set seed, (seed * 1103515245 + 12345) & 0x7fffffff\n"
+	".byte (seed >> 16) & 0xff\n"
+	".endr\n"
+	".previous\n"
+);
+
+static uint32_t data_errors(void)
+{
+	uint32_t seed = 1, errors = 0, i;
+
+	for (i = 0; i < DATA_HALF; i++) {
+		errors += load_test_data[i] != (uint8_t) ((i >> 3) ^ (i >> 9));
+	}
+
+	for (i = 0; i < DATA_HALF; i++) {
+		seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+		errors += load_test_data[DATA_HALF + i] != (uint8_t) (seed >> 16);
+	}
+
+	return errors;
+}
+
+void __entry startup32()
+{
+	const struct load_info *li = (const struct load_info *) ((BOOTSEG << 4) + MBR_LOAD_INFO_OFFSET);
+	uint32_t base = *(const uint32_t *) ((BOOTSEG << 4) + STARTUP32_OFFSET);
+
+	x86_basic_init(X86_INIT_PAGES);
+
+	if (__apicid() != 0) {
+		__asm__ volatile ("lock incl %0" : "+m" (cpus_up) :: "memory");
+		__halt();
+	}
+
+	puts("[load_test]: start\n");
+	printf("image: %u sectors on disk, %s, loaded at 0x%x (%s), dataset %u KB\n",
+		li->sectors, (li->flags & LOAD_INFO_F_LZ4) ? "lz4" : "raw", base,
+		(li->flags & LOAD_INFO_F_HIGH) ? "high" : "bda", LOAD_TEST_KB);
+
+	printf("dataset: %u errors\n", data_errors());
+
+	for (uint8_t i = 1; i < MAXCPU; i++) {
+		apic_init_thread(i, startup32);
+		apic_timer_wait_ms(100);
+	}
+
+	printf("%u cpus up\n", cpus_up);
+	boot_trace_print();
+
+	puts("[load_test]: end\n");
+	payload_done();
+}
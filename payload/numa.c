@@ -0,0 +1,135 @@
+/*
+ * numa.c - per node bump allocator over srat memory ranges
+ */
+
+#include "acpi.h"
+#include "numa.h"
+#include "lapic.h"
+#include "compiler.h"
+
+struct numa_arena {
+	uint32_t start;
+	uint32_t end;
+	volatile uint32_t cursor;
+};
+
+struct numa_arena numa_arena[NUMA_MAXNODES];
+uint32_t __use_section_data numa_nnodes = 0;
+
+static inline uint32_t cmpxchg(volatile uint32_t *p, uint32_t old, uint32_t new)
+{
+	__asm__ volatile ("lock cmpxchgl %2, %1"
+		: "+a" (old), "+m" (*p) : "r" (new) : "memory");
+	return old;
+}
+
+/* largest range of the node below 4G, clipped to the floor */
+static void arena_add(uint32_t node, uint64_t base, uint64_t length)
+{
+	struct numa_arena *a = &numa_arena[node];
+	uint64_t end = base + length;
+
+	if (base < NUMA_ALLOC_FLOOR) {
+		base = NUMA_ALLOC_FLOOR;
+	}
+
+	if (end > 0xfffff000ull) {
+		end = 0xfffff000ull;
+	}
+
+	if (end <= base || (end - base) <= (a->end - a->start)) {
+		return;
+	}
+
+	a->start = a->cursor = (uint32_t) base;
+	a->end = (uint32_t) end;
+}
+
+/* bsp, once. without an srat everything is node 0 */
+int numa_init(void)
+{
+	if (numa_nnodes) {
+		return 0;
+	}
+
+	if (acpi_init() < 0 || !acpi.nmem) {
+		arena_add(0, NUMA_ALLOC_FLOOR, NUMA_FALLBACK_END - NUMA_ALLOC_FLOOR);
+		numa_nnodes = 1;
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < acpi.nmem; i++) {
+		if (acpi.mem[i].domain < NUMA_MAXNODES) {
+			arena_add(acpi.mem[i].domain, acpi.mem[i].base, acpi.mem[i].length);
+		}
+	}
+
+	numa_nnodes = (acpi.ndomains < NUMA_MAXNODES) ? acpi.ndomains : NUMA_MAXNODES;
+	return 0;
+}
+
+int numa_ready(void)
+{
+	return numa_nnodes != 0;
+}
+
+uint32_t numa_nodes(void)
+{
+	return numa_nnodes;
+}
+
+uint32_t numa_node_of_cpu(uint32_t apic_id)
+{
+	int i = acpi_cpu_index(apic_id);
+
+	if (i < 0 || acpi.cpu_domain[i] >= numa_nnodes) {
+		return 0;
+	}
+
+	return acpi.cpu_domain[i];
+}
+
+uint32_t numa_node_of_addr(uint32_t addr)
+{
+	for (uint32_t i = 0; i < acpi.nmem; i++) {
+		if (addr >= acpi.mem[i].base && addr - acpi.mem[i].base < acpi.mem[i].length) {
+			return (acpi.mem[i].domain < numa_nnodes) ? acpi.mem[i].domain : 0;
+		}
+	}
+
+	return 0;
+}
+
+/* lock free, never freed. 0 if the node is out of memory */
+void *numa_alloc(uint32_t node, uint32_t size, uint32_t align)
+{
+	struct numa_arena *a;
+	uint32_t old, p;
+
+	if (node >= numa_nnodes || !size || (align & (align - 1))) {
+		return 0;
+	}
+
+	a = &numa_arena[node];
+	align = align ? align : 1;
+
+	do {
+		old = a->cursor;
+		p = (old + align - 1) & ~(align - 1);
+		if (p < old || p > a->end || a->end - p < size) {
+			return 0;
+		}
+	} while (cmpxchg(&a->cursor, old, p + size) != old);
+
+	return (void *) (uintptr_t) p;
+}
+
+void *numa_alloc_local(uint32_t size, uint32_t align)
+{
+	return numa_alloc(numa_node_of_cpu(apic_id()), size, align);
+}
+
+uint32_t numa_free_bytes(uint32_t node)
+{
+	return (node < numa_nnodes) ? numa_arena[node].end - numa_arena[node].cursor : 0;
+}
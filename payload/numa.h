@@ -0,0 +1,27 @@
+/*
+ * numa.h - node-local physical memory (acpi srat)
+ */
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include "inttypes.h"
+
+#define NUMA_MAXNODES     8
+
+/* below this: payload, trace/prof areas, bios */
+#define NUMA_ALLOC_FLOOR  0x1000000
+
+/* single node without an srat, qemu's default ram size */
+#define NUMA_FALLBACK_END 0x8000000
+
+int numa_init(void);
+int numa_ready(void);
+uint32_t numa_nodes(void);
+uint32_t numa_node_of_cpu(uint32_t apic_id);
+uint32_t numa_node_of_addr(uint32_t addr);
+void *numa_alloc(uint32_t node, uint32_t size, uint32_t align);
+void *numa_alloc_local(uint32_t size, uint32_t align);
+uint32_t numa_free_bytes(uint32_t node);
+
+#endif
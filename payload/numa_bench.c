@@ -0,0 +1,190 @@
+/*
+ * numa_bench.c - read bandwidth and load latency, every cpu to every node
+ *
+ * qemu: -m 256M -numa node,mem=128M,cpus=0-1 -numa node,mem=128M,cpus=2-3
+ */
+
+#include "cpu.h"
+#include "entry.h"
+#include "numa.h"
+#include "video.h"
+#include "div64.h"
+#include "lapic.h"
+#include "compiler.h"
+
+#define BUF_SIZE      0x1000000  /* per node, paging stays off */
+#define BUF_LINE      64
+#define BUF_LINES     (BUF_SIZE / BUF_LINE)
+#define CHASE_STEPS   500000
+#define READ_REPS     3
+
+struct numa_result {
+	uint64_t read_cycles;   /* best of READ_REPS over BUF_SIZE */
+	uint64_t chase_cycles;  /* CHASE_STEPS dependent loads */
+};
+
+PAYLOAD_STACKS(4096);
+struct numa_result result[MAXCPU][NUMA_MAXNODES];
+uint32_t node_buf[NUMA_MAXNODES];
+volatile uint32_t __use_section_data turn = 0;
+uint32_t __use_section_data sink = 0;
+
+static inline uint32_t xorshift32(uint32_t x)
+{
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+/* one random cycle through all lines (sattolo), each line holds the next */
+static void chase_build(uint32_t *base)
+{
+	uint32_t *line = base, seed = 0x9e3779b9, j, t;
+
+	for (uint32_t i = 0; i < BUF_LINES; i++) {
+		base[i * (BUF_LINE / 4)] = i;
+	}
+
+	for (uint32_t i = BUF_LINES - 1; i > 0; i--) {
+		seed = xorshift32(seed);
+		j = seed % i;
+		t = base[i * (BUF_LINE / 4)];
+		base[i * (BUF_LINE / 4)] = base[j * (BUF_LINE / 4)];
+		base[j * (BUF_LINE / 4)] = t;
+	}
+
+	for (uint32_t i = 0; i < BUF_LINES; i++, line += BUF_LINE / 4) {
+		*line = (uint32_t) (uintptr_t) (base + *line * (BUF_LINE / 4));
+	}
+}
+
+static uint64_t bench_read(const uint32_t *buf)
+{
+	uint64_t t, best = ~0ull;
+	uint32_t a, b, c, d;
+
+	for (int rep = 0; rep < READ_REPS; rep++) {
+		a = b = c = d = 0;
+		t = rdtsc();
+		for (uint32_t i = 0; i < BUF_SIZE / 4; i += 4) {
+			a += buf[i];
+			b += buf[i + 1];
+			c += buf[i + 2];
+			d += buf[i + 3];
+		}
+		t = rdtsc() - t;
+
+		sink += a + b + c + d;
+		best = (t < best) ? t : best;
+	}
+
+	return best;
+}
+
+static uint64_t bench_chase(uint32_t *buf)
+{
+	uint32_t *p = buf;
+	uint64_t t = rdtsc();
+
+	for (uint32_t i = 0; i < CHASE_STEPS; i++) {
+		p = (uint32_t *) (uintptr_t) *p;
+	}
+
+	t = rdtsc() - t;
+	sink += (uint32_t) (uintptr_t) p;
+	return t;
+}
+
+/* one cpu at a time, no interference between measurements */
+static void numa_run(uint8_t cpu)
+{
+	while (turn != cpu) {
+		__asm__ volatile ("pause");
+	}
+
+	for (uint32_t node = 0; node < numa_nodes(); node++) {
+		if (!node_buf[node]) {
+			continue;
+		}
+
+		result[cpu][node].read_cycles = bench_read((uint32_t *) (uintptr_t) node_buf[node]);
+		result[cpu][node].chase_cycles = bench_chase((uint32_t *) (uintptr_t) node_buf[node]);
+	}
+
+	turn = cpu + 1;
+}
+
+static inline uint32_t clamp32(uint64_t v)
+{
+	return (v >> 32) ? 0xffffffff : (uint32_t) v;
+}
+
+static void numa_report(void)
+{
+	uint32_t tsc_per_ms = apic_tsc_per_ms(), mbs, ns100;
+	struct numa_result *r;
+
+	printf("%u nodes, %u KiB per node buffer\n", numa_nodes(), BUF_SIZE >> 10);
+	printf("cpu node  mem      MB/s   ns/load\n");
+
+	for (uint8_t cpu = 0; cpu < MAXCPU; cpu++) {
+		for (uint32_t node = 0; node < numa_nodes(); node++) {
+			r = &result[cpu][node];
+			if (!node_buf[node] || !r->read_cycles || !r->chase_cycles) {
+				continue;
+			}
+
+			/* bytes/ms / 1000, and ns * 100 per load */
+			mbs = (uint32_t) div_u64((uint64_t) BUF_SIZE * tsc_per_ms,
+				clamp32(r->read_cycles)) / 1000;
+			ns100 = (uint32_t) div_u64(r->chase_cycles * 100000ull,
+				(uint32_t) div_u64((uint64_t) tsc_per_ms * CHASE_STEPS, 1000));
+
+			printf("%3u %4u %4u %9u %6u.%02u %s\n", cpu, numa_node_of_cpu(cpu), node,
+				mbs, ns100 / 100, ns100 % 100,
+				(numa_node_of_cpu(cpu) == node) ? "local" : "remote");
+		}
+	}
+}
+
+void __entry startup32()
+{
+	uint8_t apicid = __apicid();
+
+	x86_basic_init(0);
+
+	if (apicid == 0) {
+		puts("[numa_bench]: start\n");
+		numa_init();
+
+		for (uint32_t node = 0; node < numa_nodes(); node++) {
+			node_buf[node] = (uint32_t) (uintptr_t) numa_alloc(node, BUF_SIZE, BUF_LINE);
+			if (!node_buf[node]) {
+				printf("node %u: no room for the buffer\n", node);
+				continue;
+			}
+
+			printf("node %u: buffer at 0x%x\n", node, node_buf[node]);
+			chase_build((uint32_t *) (uintptr_t) node_buf[node]);
+		}
+
+		for (uint8_t i = 1; i < MAXCPU; i++) {
+			apic_init_thread(i, startup32);
+			apic_timer_wait_ms(100);
+		}
+	}
+
+	numa_run(apicid);
+	if (apicid != 0) {
+		__halt();
+	}
+
+	while (turn != MAXCPU) {
+		__asm__ volatile ("pause");
+	}
+
+	numa_report();
+	puts("[numa_bench]: end\n");
+	payload_done();
+}
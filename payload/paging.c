@@ -3,7 +3,13 @@
  */
 
 #include "cpu.h"
+#include "acpi.h"
+#include "hpet.h"
+#include "numa.h"
 #include "lapic.h"
+#include "ioapic.h"
+#include "string.h"
+#include "boottrace.h"
 #include "compiler.h"
 #include "inttypes.h"
 #include "paging.h"
@@ -27,38 +33,79 @@ typedef struct _pte32_table {
 } __align(PAGE_SIZE) pte32_table_t;
 
 /* only one address space pre cpu */
-pde32_table_t __use_section_data per_cpu_pde[MAXCPU] = { 0 };
-pte32_table_t __use_section_data per_cpu_pte[MAXCPU] = { 0 };
+pde32_table_t per_cpu_pde[MAXCPU];
+pte32_table_t per_cpu_pte[MAXCPU];
 
 /* pte to map lapic area */
-pte32_table_t __use_section_data per_cpu_lapic_pte[MAXCPU] = { 0 };
+pte32_table_t per_cpu_lapic_pte[MAXCPU];
 
 
+/* node-local copies when numa_init ran, the static tables otherwise */
+static void *page_table(void *fallback)
+{
+	void *p = numa_ready() ? numa_alloc_local(PAGE_SIZE, PAGE_SIZE) : 0;
+
+	if (!p) {
+		return fallback;
+	}
+
+	memset(p, 0, PAGE_SIZE);
+	return p;
+}
+
+/* uncached 4K page, only if it shares the lapic's 4M */
+static void map_mmio(pte32_table_t *lapic_pt, uint32_t addr)
+{
+	if ((addr >> 22) != ((uint32_t)APICBASE >> 22)) {
+		return;
+	}
+
+	lapic_pt->entry[(addr >> 12) & 0x3ff] = (addr & 0xfffff000) | PAGE_FLG_P |
+		PAGE_FLG_W | PAGE_FLG_PWT | PAGE_FLG_PCD;
+}
+
 /* set 4M identity mapping */
 void init_early_pages(void)
 {
 	uint8_t apicid = __apicid();
+	pde32_table_t *pd = page_table(&per_cpu_pde[apicid]);
+	pte32_table_t *pt = page_table(&per_cpu_pte[apicid]);
+	pte32_table_t *lapic_pt = page_table(&per_cpu_lapic_pte[apicid]);
 	pte32_t pte = 0;
-	pde32_t pde = ((pde32_t) &per_cpu_pte[apicid]) | PAGE_FLG_P | PAGE_FLG_W;
+	pde32_t pde = ((pde32_t) pt) | PAGE_FLG_P | PAGE_FLG_W;
+
+	boot_stage_cpu(apicid, BOOT_STAGE_PAGES);
 
 	/* set pde, first 4M, lapic */
-	per_cpu_pde[apicid].entry[0] = pde;
+	pd->entry[0] = pde;
 
-	pde = ((pde32_t) &per_cpu_lapic_pte[apicid]) | PAGE_FLG_P | PAGE_FLG_W;
-	per_cpu_pde[apicid].entry[(uint32_t)APICBASE >> 22] = pde;
+	pde = ((pde32_t) lapic_pt) | PAGE_FLG_P | PAGE_FLG_W;
+	pd->entry[(uint32_t)APICBASE >> 22] = pde;
 
 	/* set pte 4M, 4K pages */
 	for (uint32_t i = 0; i < (sizeof(pte32_table_t) / sizeof(pte32_t)); i++) {
 		pte = ((pte32_t) (i * PAGE_SIZE)) | PAGE_FLG_P | PAGE_FLG_W;
-		per_cpu_pte[apicid].entry[i] = pte;
+		pt->entry[i] = pte;
 	}
 
 	/* set pte lapic (4K page) */
 	pte = (uint32_t)APICBASE | PAGE_FLG_P | PAGE_FLG_W | PAGE_FLG_PWT | PAGE_FLG_PCD;
-	per_cpu_lapic_pte[apicid].entry[((uint32_t)APICBASE >> 12) & 0x3ff] = pte;
+	lapic_pt->entry[((uint32_t)APICBASE >> 12) & 0x3ff] = pte;
+
+	/* hpet, ioapics: usually in the same 4M as the lapic */
+	if (hpet_present()) {
+		map_mmio(lapic_pt, hpet_base());
+	}
+
+	map_mmio(lapic_pt, IOAPIC_DEFAULT_BASE);
+	for (uint32_t i = 0; i < acpi.nioapic; i++) {
+		map_mmio(lapic_pt, acpi.ioapic[i].addr);
+	}
 
 	/* set cr3 */
-	__writecr3((long) &per_cpu_pde[apicid]);
+	__writecr3((long) pd);
+
+	boot_stage_cpu(apicid, BOOT_STAGE_PAGES_END);
 }
 
 #if 0
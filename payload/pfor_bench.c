@@ -0,0 +1,129 @@
+/*
+ * pfor_bench.c - fill, pattern and checksum through parallel_for, 1..n cpus
+ */
+
+#include "cpu.h"
+#include "entry.h"
+#include "numa.h"
+#include "task.h"
+#include "video.h"
+#include "div64.h"
+#include "lapic.h"
+#include "string.h"
+#include "compiler.h"
+
+#define BUF_SIZE   0x1000000   /* 16M */
+#define PAGE       4096
+#define GRAIN      16          /* pages per task */
+#define REPS       3
+
+PAYLOAD_STACKS(16384);     /* nested steals while waiting */
+uint8_t *__use_section_data buf = 0;
+volatile uint32_t __use_section_data checksum = 0;
+
+static void fill_pages(uint32_t begin, uint32_t end, void *arg __attribute__((unused)))
+{
+	memset(buf + begin * PAGE, 0xa5, (end - begin) * PAGE);
+}
+
+static void pattern_pages(uint32_t begin, uint32_t end, void *arg __attribute__((unused)))
+{
+	uint32_t *w = (uint32_t *) (buf + begin * PAGE);
+
+	for (uint32_t i = begin * (PAGE / 4); i < end * (PAGE / 4); i++) {
+		*w++ = i * 0x9e3779b1 ^ (i >> 7);
+	}
+}
+
+static void checksum_pages(uint32_t begin, uint32_t end, void *arg __attribute__((unused)))
+{
+	const uint32_t *w = (const uint32_t *) (buf + begin * PAGE);
+	uint32_t sum = 0;
+
+	for (uint32_t i = 0; i < (end - begin) * (PAGE / 4); i++) {
+		sum += w[i];
+	}
+
+	__asm__ volatile ("lock addl %1, %0" : "+m" (checksum) : "r" (sum) : "memory");
+}
+
+/* best of REPS, in MB/s */
+static uint32_t run(pfor_fn_t fn)
+{
+	uint64_t t, best = ~0ull;
+
+	for (int rep = 0; rep < REPS; rep++) {
+		checksum = 0;
+		t = rdtsc();
+		parallel_for(0, BUF_SIZE / PAGE, GRAIN, fn, 0);
+		t = rdtsc() - t;
+		best = (t < best) ? t : best;
+	}
+
+	return (uint32_t) div_u64(div_u64((uint64_t) BUF_SIZE * apic_tsc_per_ms(), 1000),
+		(uint32_t) best);
+}
+
+static void pfor_run(void)
+{
+	uint32_t fill, pattern, sum, expect = 0, steals;
+
+	printf("%u cpus, %u KiB buffer at 0x%x, %u KiB grain\n", task_cpus(),
+		BUF_SIZE >> 10, (uint32_t) (uintptr_t) buf, (GRAIN * PAGE) >> 10);
+	printf("cpus   fill MB/s  pattern MB/s  checksum MB/s  steals  sum\n");
+
+	for (uint32_t n = 1; n <= MAXCPU; n++) {
+		task_set_cpus(n);
+		if (task_cpus() < n) {
+			break;
+		}
+
+		steals = 0;
+		for (uint8_t cpu = 0; cpu < MAXCPU; cpu++) {
+			steals -= task_steals(cpu);
+		}
+
+		fill = run(fill_pages);
+		pattern = run(pattern_pages);
+		sum = run(checksum_pages);
+
+		for (uint8_t cpu = 0; cpu < MAXCPU; cpu++) {
+			steals += task_steals(cpu);
+		}
+
+		if (n == 1) {
+			expect = checksum;
+		}
+
+		printf("%4u %11u %13u %14u %7u  %s\n", n, fill, pattern, sum, steals,
+			(checksum == expect) ? "ok" : "*** MISMATCH ***");
+	}
+}
+
+void __entry startup32()
+{
+	uint8_t apicid = __apicid();
+
+	x86_basic_init(0);
+	task_init();
+
+	if (apicid != 0) {
+		task_worker();
+	}
+
+	puts("[pfor_bench]: start\n");
+	if (numa_init() < 0 || !(buf = numa_alloc(0, BUF_SIZE, PAGE))) {
+		printf("*** pfor_bench: no memory for the buffer ***\n");
+		__halt();
+	}
+
+	for (uint8_t i = 1; i < MAXCPU; i++) {
+		apic_init_thread(i, startup32);
+		apic_timer_wait_ms(100);
+	}
+
+	pfor_run();
+
+	puts("[pfor_bench]: end\n");
+	payload_done();
+}
@@ -0,0 +1,148 @@
+/*
+ * pmu.c - architectural performance monitoring
+ */
+
+#include "pmu.h"
+#include "cpu.h"
+#include "string.h"
+#include "compiler.h"
+
+/* cpuid 0xa ebx bits are set when the event is NOT available */
+struct arch_event {
+	uint8_t event;
+	uint8_t umask;
+	uint8_t ebx_bit;
+	uint8_t fixed;   /* fixed counter number + 1, 0 if none */
+};
+
+static const struct arch_event arch_events[PMU_NUMEVENTS] = {
+	{ 0xc0, 0x00, 1, 1 }, /* instructions retired */
+	{ 0x3c, 0x00, 0, 2 }, /* unhalted core cycles */
+	{ 0x2e, 0x41, 4, 0 }, /* llc misses */
+	{ 0xc5, 0x00, 6, 0 }, /* branch mispredicts retired */
+};
+
+const char pmu_event_name[PMU_NUMEVENTS][12] = {
+	"instr", "cycles", "llc-miss", "br-miss"
+};
+
+struct pmu_info __use_section_data pmu;
+
+static inline uint64_t width_mask(uint32_t width)
+{
+	return (width >= 64) ? ~0ull : (1ull << width) - 1;
+}
+
+/* stop and clear everything this driver can touch */
+static void pmu_reset(uint32_t ngp, uint32_t nfixed, uint32_t version)
+{
+	if (version >= 2) {
+		__wrmsr(IA32_PERF_GLOBAL_CTRL, 0);
+		__wrmsr(IA32_FIXED_CTR_CTRL, 0);
+		__wrmsr(IA32_PERF_GLOBAL_OVF_CTRL, __rdmsr(IA32_PERF_GLOBAL_STATUS));
+	}
+
+	for (uint32_t i = 0; i < ngp; i++) {
+		__wrmsr(IA32_PERFEVTSEL0 + i, 0);
+		__wrmsr(IA32_PMC0 + i, 0);
+	}
+
+	for (uint32_t i = 0; i < nfixed; i++) {
+		__wrmsr(IA32_FIXED_CTR0 + i, 0);
+	}
+}
+
+/*
+ * per cpu: counts in ring 0 and 3, fixed counters first, general purpose
+ * counters in event order. returns -1 without an architectural pmu (amd,
+ * most emulators).
+ */
+int pmu_init(void)
+{
+	uint32_t a = 0, b = 0, c = 0, d = 0, gpw, fixw = 0, ebxlen;
+	uint32_t fixed_ctrl = 0, global = 0, ngp, nfixed = 0, version;
+	struct pmu_info info;
+	int first = -1;
+
+	__cpuid(&a, &b, &c, &d);
+	if (a < 0xa) {
+		return -1;
+	}
+
+	a = 0xa;
+	c = 0;
+	__cpuid(&a, &b, &c, &d);
+
+	version = a & 0xff;
+	ngp = (a >> 8) & 0xff;
+	gpw = (a >> 16) & 0xff;
+	ebxlen = (a >> 24) & 0xff;
+	if (version == 0) {
+		return -1;
+	}
+
+	if (version >= 2) {
+		nfixed = d & 0x1f;
+		fixw = (d >> 5) & 0xff;
+	}
+
+	ngp = (ngp > PMU_MAXGP) ? PMU_MAXGP : ngp;
+	pmu_reset(ngp, nfixed, version);
+
+	memset(&info, 0, sizeof(info));
+	info.version = version;
+	info.ngp = ngp;
+	info.nfixed = nfixed;
+
+	for (int i = 0; i < PMU_NUMEVENTS; i++) {
+		const struct arch_event *e = &arch_events[i];
+		uint32_t fixed = e->fixed - 1;
+
+		if (e->fixed && fixed < nfixed) {
+			info.index[i] = PMU_RDPMC_FIXED | fixed;
+			info.mask[i] = width_mask(fixw);
+			fixed_ctrl |= 0x3 << (fixed * 4);   /* os + usr */
+			global |= 1u << fixed;              /* high dword */
+		} else if (e->ebx_bit < ebxlen && !(b & (1 << e->ebx_bit)) &&
+			info.gp_used < ngp) {
+			info.index[i] = info.gp_used;
+			info.mask[i] = width_mask(gpw);
+			__wrmsr(IA32_PERFEVTSEL0 + info.gp_used, e->event | (e->umask << 8) |
+				PERFEVTSEL_USR | PERFEVTSEL_OS | PERFEVTSEL_EN);
+			info.gp_used++;
+		} else {
+			continue;
+		}
+
+		info.supported |= 1 << i;
+		first = (first < 0) ? i : first;
+	}
+
+	if (first < 0) {
+		return -1;
+	}
+
+	/* unsupported events read a live counter, masked to 0 */
+	for (int i = 0; i < PMU_NUMEVENTS; i++) {
+		if (!(info.supported & (1 << i))) {
+			info.index[i] = info.index[first];
+		}
+	}
+
+	__writecr4(__readcr4() | CR4_PCE);
+
+	if (version >= 2) {
+		__wrmsr(IA32_FIXED_CTR_CTRL, fixed_ctrl);
+		__wrmsr(IA32_PERF_GLOBAL_CTRL, ((uint64_t) global << 32) |
+			((1u << info.gp_used) - 1));
+	}
+
+	/* same on every cpu */
+	pmu = info;
+	return 0;
+}
+
+void pmu_region_reset(pmu_region_t *r)
+{
+	memset(r, 0, sizeof(*r));
+}
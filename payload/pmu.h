@@ -0,0 +1,79 @@
+/*
+ * pmu.h - architectural performance monitoring (cpuid leaf 0xa)
+ */
+
+#ifndef PMU_H
+#define PMU_H
+
+#include "cpu.h"
+#include "inttypes.h"
+
+/* msrs */
+#define IA32_PMC0                 0xc1
+#define IA32_PERFEVTSEL0          0x186
+#define IA32_FIXED_CTR0           0x309
+#define IA32_FIXED_CTR_CTRL       0x38d
+#define IA32_PERF_GLOBAL_STATUS   0x38e
+#define IA32_PERF_GLOBAL_CTRL     0x38f
+#define IA32_PERF_GLOBAL_OVF_CTRL 0x390
+
+/* perfevtsel bits */
+#define PERFEVTSEL_USR 0x00010000
+#define PERFEVTSEL_OS  0x00020000
+#define PERFEVTSEL_INT 0x00100000
+#define PERFEVTSEL_EN  0x00400000
+
+/* rdpmc ecx for fixed counters */
+#define PMU_RDPMC_FIXED 0x40000000
+
+#define PMU_MAXGP 8
+
+enum {
+	PMU_INSTRUCTIONS,
+	PMU_CYCLES,
+	PMU_LLC_MISSES,
+	PMU_BRANCH_MISSES,
+	PMU_NUMEVENTS
+};
+
+struct pmu_info {
+	uint8_t version;
+	uint8_t ngp;                    /* general purpose counters */
+	uint8_t nfixed;                 /* fixed counters (v2+) */
+	uint8_t gp_used;                /* first ngp_used counters are taken */
+	uint32_t supported;             /* 1 << PMU_x */
+	uint32_t index[PMU_NUMEVENTS];  /* rdpmc ecx */
+	uint64_t mask[PMU_NUMEVENTS];   /* counter width, 0 if not supported */
+};
+
+typedef struct _pmu_region {
+	uint64_t start[PMU_NUMEVENTS];
+	uint64_t count[PMU_NUMEVENTS];
+} pmu_region_t;
+
+extern struct pmu_info pmu;
+extern const char pmu_event_name[PMU_NUMEVENTS][12];
+
+int pmu_init(void);
+void pmu_region_reset(pmu_region_t *r);
+
+/*
+ * counters are read with rdpmc (not serializing). unsupported events read
+ * a valid counter with a zero mask, so there is no branch per event.
+ */
+static inline void pmu_region_begin(pmu_region_t *r)
+{
+	for (int i = 0; i < PMU_NUMEVENTS; i++) {
+		r->start[i] = rdpmc(pmu.index[i]);
+	}
+}
+
+/* accumulates, a region can be entered many times */
+static inline void pmu_region_end(pmu_region_t *r)
+{
+	for (int i = PMU_NUMEVENTS - 1; i >= 0; i--) {
+		r->count[i] += (rdpmc(pmu.index[i]) - r->start[i]) & pmu.mask[i];
+	}
+}
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ * pmu_test.c - hardware counters around small kernels, on every cpu, then
+ * the same kernels under the sampling profiler (see bmprof)
+ */
+
+#include "cpu.h"
+#include "entry.h"
+#include "pmu.h"
+#include "prof.h"
+#include "video.h"
+#include "lapic.h"
+#include "compiler.h"
+
+#define LOOP_ITERS    1000000
+#define BRANCH_ITERS  1000000
+#define CHASE_STEPS   1000000
+#define PROF_PERIOD   100000  /* core cycles per sample */
+
+/* per cpu pointer chase buffers, paging stays off */
+#define CHASE_BASE    0x1000000
+#define CHASE_SIZE    0x1000000
+#define CHASE_LINE    64
+#define CHASE_LINES   (CHASE_SIZE / CHASE_LINE)
+
+enum {
+	K_LOOP,     /* dependent adds, high ipc */
+	K_BRANCH,   /* random branches, ~50% mispredicted */
+	K_CHASE,    /* random cache lines, llc misses */
+	K_NUMKERNELS
+};
+
+struct pmu_cpu {
+	pmu_region_t region[K_NUMKERNELS];
+	uint64_t tsc[K_NUMKERNELS];
+	uint32_t result;
+	volatile uint32_t done;
+} __align(64);
+
+PAYLOAD_STACKS(4096);
+struct pmu_cpu pcpu[MAXCPU];
+
+static const char kernel_name[K_NUMKERNELS][8] = { "loop", "branch", "chase" };
+
+static inline uint32_t xorshift32(uint32_t x)
+{
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+static uint32_t kernel_loop(void)
+{
+	uint32_t acc = 0;
+
+	for (uint32_t i = 0; i < LOOP_ITERS; i++) {
+		acc += i;
+		__asm__ volatile ("" : "+r" (acc));
+	}
+
+	return acc;
+}
+
+static uint32_t kernel_branch(uint32_t seed)
+{
+	uint32_t acc = 0;
+
+	for (uint32_t i = 0; i < BRANCH_ITERS; i++) {
+		seed = xorshift32(seed);
+		/* the asm keeps it a branch, not a cmov */
+		if (seed & 0x100) {
+			acc += seed;
+			__asm__ volatile ("" : "+r" (acc));
+		}
+	}
+
+	return acc;
+}
+
+/* single cycle through all lines (sattolo), each line holds the next */
+static void chase_build(uint32_t *base, uint32_t seed)
+{
+	uint32_t *line = base, j, t;
+
+	for (uint32_t i = 0; i < CHASE_LINES; i++) {
+		base[i * (CHASE_LINE / 4)] = i;
+	}
+
+	for (uint32_t i = CHASE_LINES - 1; i > 0; i--) {
+		seed = xorshift32(seed);
+		j = seed % i;
+		t = base[i * (CHASE_LINE / 4)];
+		base[i * (CHASE_LINE / 4)] = base[j * (CHASE_LINE / 4)];
+		base[j * (CHASE_LINE / 4)] = t;
+	}
+
+	for (uint32_t i = 0; i < CHASE_LINES; i++, line += CHASE_LINE / 4) {
+		*line = (uint32_t) (uintptr_t) (base + *line * (CHASE_LINE / 4));
+	}
+}
+
+static uint32_t kernel_chase(uint32_t *base)
+{
+	uint32_t *p = base;
+
+	for (uint32_t i = 0; i < CHASE_STEPS; i++) {
+		p = (uint32_t *) (uintptr_t) *p;
+	}
+
+	return (uint32_t) (uintptr_t) p;
+}
+
+static uint32_t kernel_run(int k, uint32_t seed, uint32_t *chase)
+{
+	switch (k) {
+		case K_LOOP:
+			return kernel_loop();
+		case K_BRANCH:
+			return kernel_branch(seed);
+		case K_CHASE:
+			return kernel_chase(chase);
+	}
+
+	return 0;
+}
+
+static void pmu_run(struct pmu_cpu *c, uint8_t cpu)
+{
+	uint32_t *chase = (uint32_t *) (uintptr_t) (CHASE_BASE + cpu * CHASE_SIZE);
+	uint32_t seed = 0x9e3779b9 ^ cpu;
+	uint64_t tsc;
+
+	chase_build(chase, seed);
+
+	for (int k = 0; k < K_NUMKERNELS; k++) {
+		pmu_region_reset(&c->region[k]);
+		tsc = rdtsc();
+		pmu_region_begin(&c->region[k]);
+		c->result += kernel_run(k, seed, chase);
+		pmu_region_end(&c->region[k]);
+		c->tsc[k] = rdtsc() - tsc;
+	}
+
+	/* again, sampled */
+	if (prof_start() < 0) {
+		return;
+	}
+
+	for (int k = 0; k < K_NUMKERNELS; k++) {
+		c->result += kernel_run(k, seed, chase);
+	}
+
+	prof_stop();
+}
+
+static void pmu_report(void)
+{
+	printf("pmu: version %u, %u gp, %u fixed\n", pmu.version, pmu.ngp, pmu.nfixed);
+	printf("cpu kernel ");
+	for (int i = 0; i < PMU_NUMEVENTS; i++) {
+		printf("%11s", (pmu.supported & (1 << i)) ? pmu_event_name[i] : "-");
+	}
+	printf("%11s\n", "tsc");
+
+	for (uint8_t cpu = 0; cpu < MAXCPU; cpu++) {
+		for (int k = 0; k < K_NUMKERNELS; k++) {
+			printf("%3u %-6s ", cpu, kernel_name[k]);
+			for (int i = 0; i < PMU_NUMEVENTS; i++) {
+				printf("%11llu", pcpu[cpu].region[k].count[i]);
+			}
+			printf("%11llu\n", pcpu[cpu].tsc[k]);
+		}
+	}
+
+	printf("prof samples:");
+	for (uint8_t cpu = 0; cpu < MAXCPU; cpu++) {
+		printf(" %u", prof_ring(cpu)->head);
+	}
+	putchar('\n');
+}
+
+void __entry startup32()
+{
+	uint8_t apicid = __apicid();
+
+	x86_basic_init(0);
+
+	if (pmu_init() < 0) {
+		printf("*** cpu %u: no architectural pmu ***\n", apicid);
+		__halt();
+	}
+
+	if (apicid == 0) {
+		puts("[pmu_test]: start\n");
+		prof_init(PROF_PERIOD);
+		for (uint8_t i = 1; i < MAXCPU; i++) {
+			apic_init_thread(i, startup32);
+			apic_timer_wait_ms(100);
+		}
+	}
+
+	pmu_run(&pcpu[apicid], apicid);
+
+	pcpu[apicid].done = 1;
+	if (apicid != 0) {
+		__halt();
+	}
+
+	for (uint8_t i = 0; i < MAXCPU; i++) {
+		while (!pcpu[i].done) {
+			__asm__ volatile ("pause");
+		}
+	}
+
+	pmu_report();
+	puts("[pmu_test]: end\n");
+	payload_done();
+}
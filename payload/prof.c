@@ -0,0 +1,124 @@
+/*
+ * prof.c - nmi sampling profiler
+ *
+ * one general purpose counter (the first one pmu_init left free) counts
+ * core cycles from -period. the overflow pmi is delivered as an nmi (lvt
+ * perfc), the handler stores the interrupted eip and re-arms the counter.
+ */
+
+#include "cpu.h"
+#include "idt.h"
+#include "pmu.h"
+#include "prof.h"
+#include "lapic.h"
+#include "video.h"
+#include "compiler.h"
+
+#define NMI_VECTOR     2
+#define PROF_EVENT     0x3c /* unhalted core cycles */
+
+/* from script.ld */
+extern const char __payload_start[] __hidden;
+
+uint32_t __use_section_data prof_period = 0;
+
+uint32_t prof_area_size(void)
+{
+	return sizeof(struct prof_header) + MAXCPU * sizeof(struct prof_ring);
+}
+
+static inline void prof_arm(uint32_t counter)
+{
+	/* 32-bit writes are sign extended to the counter width */
+	__wrmsr(IA32_PMC0 + counter, (uint32_t) -prof_period);
+}
+
+static void prof_nmi(isr_regs_t *regs)
+{
+	struct prof_ring *ring = prof_ring(apic_id());
+	uint32_t counter = pmu.gp_used;
+
+	if (pmu.version >= 2 &&
+		!(__rdmsr(IA32_PERF_GLOBAL_STATUS) & (1ull << counter))) {
+		ring->other++;
+		return;
+	}
+
+	if (ring->head < PROF_RING_SIZE) {
+		ring->eip[ring->head] = regs->ip;
+	}
+	ring->head++;
+
+	prof_arm(counter);
+	if (pmu.version >= 2) {
+		__wrmsr(IA32_PERF_GLOBAL_OVF_CTRL, 1ull << counter);
+	}
+
+	/* the pmi masks lvt perfc */
+	apic_pmi_unmask();
+}
+
+/* bsp only, after pmu_init, before waking up the aps */
+void prof_init(uint32_t period)
+{
+	struct prof_header *hdr = (struct prof_header *) PROF_AREA;
+	struct prof_ring *ring;
+
+	hdr->magic = PROF_MAGIC;
+	hdr->version = PROF_VERSION;
+	hdr->ncpu = MAXCPU;
+	hdr->ring_size = PROF_RING_SIZE;
+	hdr->text_base = (uint32_t) (uintptr_t) __payload_start;
+	hdr->period = period;
+	hdr->zero[0] = hdr->zero[1] = 0;
+
+	for (uint8_t i = 0; i < MAXCPU; i++) {
+		ring = prof_ring(i);
+		ring->magic = PROF_MAGIC;
+		ring->cpu = i;
+		ring->head = 0;
+		ring->other = 0;
+	}
+
+	prof_period = period;
+	idt_set_handler(NMI_VECTOR, prof_nmi);
+	printf("prof: area at 0x%x, %u bytes, every %u cycles\n", PROF_AREA,
+		prof_area_size(), period);
+}
+
+/* per cpu, -1 if no counter is left or prof_init wasn't called */
+int prof_start(void)
+{
+	uint32_t counter = pmu.gp_used;
+
+	if (!prof_period || !pmu.version || counter >= pmu.ngp) {
+		return -1;
+	}
+
+	apic_pmi_unmask();
+	prof_arm(counter);
+	__wrmsr(IA32_PERFEVTSEL0 + counter, PROF_EVENT | PERFEVTSEL_USR |
+		PERFEVTSEL_OS | PERFEVTSEL_INT | PERFEVTSEL_EN);
+
+	if (pmu.version >= 2) {
+		__wrmsr(IA32_PERF_GLOBAL_CTRL,
+			__rdmsr(IA32_PERF_GLOBAL_CTRL) | (1ull << counter));
+	}
+
+	return 0;
+}
+
+void prof_stop(void)
+{
+	uint32_t counter = pmu.gp_used;
+
+	if (counter >= pmu.ngp) {
+		return;
+	}
+
+	__wrmsr(IA32_PERFEVTSEL0 + counter, 0);
+	if (pmu.version >= 2) {
+		__wrmsr(IA32_PERF_GLOBAL_CTRL,
+			__rdmsr(IA32_PERF_GLOBAL_CTRL) & ~(1ull << counter));
+	}
+}
@@ -0,0 +1,22 @@
+/*
+ * prof.h - nmi sampling profiler (pmu overflow)
+ */
+
+#ifndef PROF_H
+#define PROF_H
+
+#include "inttypes.h"
+#include "profbuf.h"
+
+static inline struct prof_ring *prof_ring(uint8_t cpu)
+{
+	struct prof_header *hdr = (struct prof_header *) PROF_AREA;
+	return &((struct prof_ring *) (hdr + 1))[cpu];
+}
+
+void prof_init(uint32_t period);
+int prof_start(void);
+void prof_stop(void);
+uint32_t prof_area_size(void);
+
+#endif
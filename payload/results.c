@@ -0,0 +1,175 @@
+/*
+ * results.c - results staged at RESULTS_AREA, written to the results region
+ *
+ * bminstall reserves the region as a RESULTS_PART_TYPE partition at the
+ * end of the disk, its lba comes from the mbr the bios left at 0x7c00.
+ * records are added from any cpu, results_flush() runs on the bsp with
+ * the others quiet (bios_disk_write). payloads run by payload/chain append
+ * to the region behind a RESULTS_T_PAYLOAD record instead.
+ */
+
+#include "cpu.h"
+#include "bios.h"
+#include "boot.h"
+#include "lapic.h"
+#include "video.h"
+#include "string.h"
+#include "results.h"
+#include "compiler.h"
+
+#define PART_TYPE   4
+#define PART_START  8
+#define PART_COUNT  12
+#define PART_SIZE   16
+
+uint32_t __use_section_data results_lba = 0;
+uint32_t __use_section_data results_max = 0;
+volatile uint32_t __use_section_data results_next = 0;
+uint8_t __use_section_data results_drive = 0;
+
+static inline struct results_header *results_header(void)
+{
+	return (struct results_header *) RESULTS_AREA;
+}
+
+static inline struct results_record *results_records(void)
+{
+	return (struct results_record *) (results_header() + 1);
+}
+
+static uint32_t mbr_u32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/* records the earlier payloads of a chain wrote, -1 when the region is empty or bad */
+static int results_resume(void)
+{
+	struct results_header *hdr = results_header();
+	uint32_t crc, n;
+
+	if (bios_disk_read(results_drive, results_lba, hdr, 1) || hdr->magic != RESULTS_MAGIC) {
+		return -1;
+	}
+
+	crc = hdr->header_crc;
+	hdr->header_crc = 0;
+	n = hdr->nrecords;
+	if (results_crc32(hdr, sizeof(*hdr)) != crc || hdr->version != RESULTS_VERSION
+		|| hdr->record_size != sizeof(struct results_record) || n >= RESULTS_MAX_RECORDS) {
+		return -1;
+	}
+
+	if (bios_disk_read(results_drive, results_lba, hdr,
+		(sizeof(*hdr) + n * sizeof(struct results_record) + 511) / 512)) {
+		return -1;
+	}
+
+	/* a torn record region starts over, results_flush would bless it */
+	if (results_crc32(results_records(), n * sizeof(struct results_record)) != hdr->data_crc) {
+		return -1;
+	}
+
+	return (int) n;
+}
+
+/* -1 when the disk has no results partition */
+int results_init(const char *payload)
+{
+	const uint8_t *part = (const uint8_t *) ((BOOTSEG << 4) + MBR_PART_TABLE_OFFSET);
+	const struct load_info *li = (const struct load_info *) ((BOOTSEG << 4) + MBR_LOAD_INFO_OFFSET);
+	struct results_header *hdr = results_header();
+	uint32_t count = 0;
+	int resumed;
+
+	results_max = 0;
+	for (int i = 0; i < 4; i++, part += PART_SIZE) {
+		if (part[PART_TYPE] == RESULTS_PART_TYPE) {
+			results_lba = mbr_u32(part + PART_START);
+			count = mbr_u32(part + PART_COUNT);
+			break;
+		}
+	}
+
+	if (count < RESULTS_SECTORS) {
+		return -1;
+	}
+
+	results_drive = bios_boot_drive();
+	results_max = RESULTS_MAX_RECORDS;
+	if ((li->flags & LOAD_INFO_F_CHAIN) && (resumed = results_resume()) >= 0) {
+		results_next = resumed;
+		results_add(RESULTS_T_PAYLOAD, payload, 0, 0, 0);
+		return 0;
+	}
+
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = RESULTS_MAGIC;
+	hdr->version = RESULTS_VERSION;
+	hdr->header_size = sizeof(*hdr);
+	hdr->record_size = sizeof(struct results_record);
+	hdr->tsc_khz = apic_tsc_per_ms();
+	hdr->tsc = rdtsc();
+	for (int i = 0; i < (int) sizeof(hdr->payload) - 1 && payload[i]; i++) {
+		hdr->payload[i] = payload[i];
+	}
+
+	results_next = 0;
+	return 0;
+}
+
+uint32_t results_count(void)
+{
+	return (results_next < results_max) ? results_next : results_max;
+}
+
+/* -1 before results_init() or when the region is full */
+int results_add(uint16_t type, const char *name, uint16_t cpu,
+	const uint64_t *value, uint32_t count)
+{
+	struct results_record *rec;
+	uint32_t slot = 1;
+
+	if (count > RESULTS_VALUES || !results_max) {
+		return -1;
+	}
+
+	__asm__ volatile ("lock xaddl %0, %1" : "+r" (slot), "+m" (results_next) :: "memory");
+	if (slot >= results_max) {
+		return -1;
+	}
+
+	rec = &results_records()[slot];
+	memset(rec, 0, sizeof(*rec));
+	rec->type = type;
+	rec->cpu = cpu;
+	rec->count = count;
+	for (int i = 0; i < (int) sizeof(rec->name) - 1 && name[i]; i++) {
+		rec->name[i] = name[i];
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		rec->value[i] = value[i];
+	}
+
+	return 0;
+}
+
+/* header and records, the sectors they cover */
+int results_flush(void)
+{
+	struct results_header *hdr = results_header();
+	uint32_t n = results_count(), bytes;
+
+	if (!results_max) {
+		return -1;
+	}
+
+	hdr->nrecords = n;
+	hdr->data_crc = results_crc32(results_records(), n * sizeof(struct results_record));
+	hdr->header_crc = 0;
+	hdr->header_crc = results_crc32(hdr, sizeof(*hdr));
+
+	bytes = sizeof(*hdr) + n * sizeof(struct results_record);
+	return bios_disk_write(results_drive, results_lba, hdr, (bytes + 511) / 512);
+}
@@ -0,0 +1,20 @@
+/*
+ * results.h - benchmark results persisted to the disk results region
+ */
+
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include "inttypes.h"
+#include "resultbuf.h"
+
+#define RESULTS_MAX_RECORDS \
+	((RESULTS_SECTORS * 512 - sizeof(struct results_header)) / sizeof(struct results_record))
+
+int results_init(const char *payload);
+int results_add(uint16_t type, const char *name, uint16_t cpu,
+	const uint64_t *value, uint32_t count);
+int results_flush(void);
+uint32_t results_count(void);
+
+#endif
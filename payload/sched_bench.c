@@ -0,0 +1,185 @@
+/*
+ * sched_bench.c - thread switch cost and timer preemption on every cpu
+ */
+
+#include "cpu.h"
+#include "entry.h"
+#include "fpu.h"
+#include "video.h"
+#include "div64.h"
+#include "lapic.h"
+#include "thread.h"
+#include "compiler.h"
+
+#define SLICE_US     1000
+#define YIELD_ITERS  100000
+#define SPIN_MS      200
+#define VEC_MAX      64
+
+struct bench_cpu {
+	uint64_t yield_cycles[2];   /* plain, with vector state */
+	uint32_t yield_switches[2];
+	uint64_t deadline;          /* spin test end, tsc */
+	uint32_t spins[2];
+	uint32_t preempts;
+} __align(64);
+
+PAYLOAD_STACKS(4096);
+struct bench_cpu bench[MAXCPU];
+uint8_t __align(64) pattern[VEC_MAX];
+volatile uint32_t __use_section_data cpus_ready = 0;
+
+/* built general-regs-only, the widest register is loaded by hand */
+static void vec_load(const uint8_t *p)
+{
+	if (x86_xcr0 & XCR0_AVX512) {
+		__asm__ volatile ("vmovdqu64 (%0), %%zmm0" :: "r" (p) : "memory");
+	} else if (x86_xcr0 & XCR0_AVX) {
+		__asm__ volatile ("vmovdqu (%0), %%ymm0" :: "r" (p) : "memory");
+	} else {
+		__asm__ volatile ("movdqu (%0), %%xmm0" :: "r" (p) : "memory");
+	}
+}
+
+/* two of these per cpu ping-pong through the run queue */
+static void yield_thread(void *arg)
+{
+	struct bench_cpu *b = &bench[apic_id()];
+	uint32_t vec = (uint32_t) (uintptr_t) arg, switches = sched_switches(apic_id());
+	uint64_t tsc = rdtsc();
+
+	for (uint32_t i = 0; i < YIELD_ITERS; i++) {
+		if (vec) {
+			vec_load(pattern);
+		}
+		thread_yield();
+	}
+
+	tsc = rdtsc() - tsc;
+	if (tsc > b->yield_cycles[vec]) {
+		b->yield_cycles[vec] = tsc;
+		b->yield_switches[vec] = sched_switches(apic_id()) - switches;
+	}
+}
+
+/* never yields, only the timer takes the cpu away */
+static void spin_thread(void *arg)
+{
+	struct bench_cpu *b = &bench[apic_id()];
+	uint32_t n = 0;
+
+	while (rdtsc() < b->deadline) {
+		n++;
+	}
+
+	b->spins[(uintptr_t) arg] = n;
+}
+
+static void run_pair(thread_fn_t fn, uintptr_t arg0, uintptr_t arg1)
+{
+	struct thread *t[MAXCPU][2];
+
+	for (uint8_t cpu = 0; cpu < MAXCPU; cpu++) {
+		t[cpu][0] = thread_create(cpu, fn, (void *) arg0);
+		t[cpu][1] = thread_create(cpu, fn, (void *) arg1);
+		if (!t[cpu][0] || !t[cpu][1]) {
+			printf("*** sched_bench: no memory for threads ***\n");
+			__halt();
+		}
+	}
+
+	for (uint8_t cpu = 0; cpu < MAXCPU; cpu++) {
+		thread_join(t[cpu][0]);
+		thread_join(t[cpu][1]);
+	}
+}
+
+static uint32_t per_switch(uint64_t cycles, uint32_t switches)
+{
+	return switches ? (uint32_t) div_u64(cycles, switches) : 0;
+}
+
+static void sched_report(void)
+{
+	struct bench_cpu *b;
+	uint32_t total;
+
+	printf("cpu  cycles/switch  +vector  preempts  share\n");
+	for (uint8_t cpu = 0; cpu < MAXCPU; cpu++) {
+		b = &bench[cpu];
+		total = b->spins[0] + b->spins[1];
+		printf("%3u %14u %8u %9u  %u%%/%u%%\n", cpu,
+			per_switch(b->yield_cycles[0], b->yield_switches[0]),
+			per_switch(b->yield_cycles[1], b->yield_switches[1]),
+			b->preempts,
+			total ? (uint32_t) div_u64((uint64_t) b->spins[0] * 100, total) : 0,
+			total ? (uint32_t) div_u64((uint64_t) b->spins[1] * 100, total) : 0);
+	}
+}
+
+static void sched_run(void)
+{
+	uint64_t deadline;
+	uint32_t preempts[MAXCPU];
+
+	for (uint32_t i = 0; i < VEC_MAX; i++) {
+		pattern[i] = (uint8_t) (0x5a ^ i);
+	}
+
+	run_pair(yield_thread, 0, 0);
+	run_pair(yield_thread, 1, 1);
+
+	for (uint8_t cpu = 0; cpu < MAXCPU; cpu++) {
+		preempts[cpu] = sched_preemptions(cpu);
+	}
+
+	deadline = rdtsc() + (uint64_t) SPIN_MS * apic_tsc_per_ms();
+	for (uint8_t cpu = 0; cpu < MAXCPU; cpu++) {
+		bench[cpu].deadline = deadline;
+	}
+
+	run_pair(spin_thread, 0, 1);
+
+	for (uint8_t cpu = 0; cpu < MAXCPU; cpu++) {
+		bench[cpu].preempts = sched_preemptions(cpu) - preempts[cpu];
+	}
+}
+
+void __entry startup32()
+{
+	uint8_t apicid = __apicid();
+
+	x86_basic_init(0);
+
+	if (sched_init() < 0) {
+		printf("*** sched_bench: cpu %u sched_init failed ***\n", apicid);
+		__halt();
+	}
+
+	/* the apic timer belongs to the scheduler from here on */
+	if (apicid != 0) {
+		sched_start(SLICE_US);
+		__asm__ volatile ("lock incl %0" : "+m" (cpus_ready) :: "memory");
+		sched_idle();
+	}
+
+	puts("[sched_bench]: start\n");
+	printf("%u us slice, %s fpu switch, %u byte area\n", SLICE_US,
+		fpu_lazy() ? "lazy" : "eager", x86_xsave_size);
+
+	for (uint8_t i = 1; i < MAXCPU; i++) {
+		apic_init_thread(i, startup32);
+		apic_timer_wait_ms(100);
+	}
+
+	while (cpus_ready != MAXCPU - 1) {
+		__asm__ volatile ("pause");
+	}
+
+	sched_start(SLICE_US);
+	sched_run();
+	sched_report();
+
+	puts("[sched_bench]: end\n");
+	payload_done();
+}
@@ -0,0 +1,197 @@
+/*
+ * smi_detect.c - tsc gaps with interrupts masked on every cpu (smi, hypervisor)
+ *
+ * like hwlat_detector: each cpu spins on rdtsc with interrupts off, a gap
+ * above the threshold is time the cpu didn't run this loop. MSR_SMI_COUNT
+ * (intel) before and after tells how many of them were smis.
+ */
+
+#include "cpu.h"
+#include "idt.h"
+#include "entry.h"
+#include "hist.h"
+#include "video.h"
+#include "div64.h"
+#include "lapic.h"
+#include "barrier.h"
+#include "compiler.h"
+
+#define NOISE_SECONDS     10
+#define NOISE_THRESHOLD   1000     /* ns */
+#define NOISE_POW2_ROWS   12       /* threshold, 2x, 4x, ... */
+#define MSR_SMI_COUNT     0x34
+#define GP_VECTOR         13
+#define RDMSR_LEN         2        /* 0f 32 */
+
+struct noise_cpu {
+	uint64_t stolen;          /* tsc cycles in gaps */
+	uint32_t smis;
+	uint32_t min_loop;        /* cycles, the loop's own cost */
+	hist_t gaps;              /* ns */
+} __align(64);
+
+PAYLOAD_STACKS(4096);
+struct noise_cpu noise[MAXCPU];
+struct barrier __use_section_data start_barrier;
+volatile uint32_t __use_section_data cpus_up = 1;
+volatile uint32_t __use_section_data cpus_done = 0;
+volatile uint32_t __use_section_data go = 0;
+int __use_section_data has_smi_count = 0;
+volatile int __use_section_data msr_faulted = 0;
+
+/* the probe's rdmsr faulted: skip it */
+static void msr_probe_gp(isr_regs_t *regs)
+{
+	msr_faulted = 1;
+	regs->ip += RDMSR_LEN;
+}
+
+/*
+ * MSR_SMI_COUNT is intel only, and not on every intel part (pre-nehalem,
+ * some hypervisors): one read under a temporary #gp handler decides
+ */
+static int smi_count_supported(void)
+{
+	uint32_t a = 0, b = 0, c = 0, d = 0;
+
+	__cpuid(&a, &b, &c, &d);
+	if (b != 0x756e6547 || d != 0x49656e69 || c != 0x6c65746e) {
+		return 0;
+	}
+
+	msr_faulted = 0;
+	idt_set_handler(GP_VECTOR, msr_probe_gp);
+	(void) __rdmsr(MSR_SMI_COUNT);
+	idt_set_handler(GP_VECTOR, 0);
+
+	return !msr_faulted;
+}
+
+static void noise_run(uint8_t cpu)
+{
+	struct noise_cpu *n = &noise[cpu];
+	uint32_t tsc_per_ms = apic_tsc_per_ms(), smi = 0;
+	uint64_t thr = div_u64((uint64_t) tsc_per_ms * NOISE_THRESHOLD, 1000000);
+	uint64_t last, now, gap, end;
+	uint32_t min_loop = 0xffffffff;
+
+	hist_reset(&n->gaps);
+	n->stolen = 0;
+
+	barrier_wait(&start_barrier);
+	cli();
+
+	if (has_smi_count) {
+		smi = (uint32_t) __rdmsr(MSR_SMI_COUNT);
+	}
+
+	last = rdtsc();
+	end = last + (uint64_t) NOISE_SECONDS * 1000 * tsc_per_ms;
+	do {
+		now = rdtsc();
+		gap = now - last;
+		if (gap > thr) {
+			n->stolen += gap;
+			hist_add(&n->gaps, (uint32_t) div_u64(gap * 1000000, tsc_per_ms));
+		} else if (gap < min_loop) {
+			min_loop = (uint32_t) gap;
+		}
+		last = now;
+	} while (now < end);
+
+	if (has_smi_count) {
+		n->smis = (uint32_t) __rdmsr(MSR_SMI_COUNT) - smi;
+	}
+
+	sti();
+	n->min_loop = min_loop;
+}
+
+/* gaps per power of two above the threshold */
+static void noise_hist(uint8_t cpu)
+{
+	const hist_t *h = &noise[cpu].gaps;
+	uint32_t rows[NOISE_POW2_ROWS] = { 0 }, low, row;
+
+	for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+		if (!h->count[i]) {
+			continue;
+		}
+
+		low = hist_bucket_low(i) / NOISE_THRESHOLD;
+		for (row = 0; row < NOISE_POW2_ROWS - 1 && (2u << row) <= low; row++)
+			;
+		rows[row] += h->count[i];
+	}
+
+	printf("cpu %u gaps:", cpu);
+	for (row = 0; row < NOISE_POW2_ROWS; row++) {
+		if (rows[row]) {
+			printf(" %s%uus:%u", (row == NOISE_POW2_ROWS - 1) ? ">=" : "<",
+				(NOISE_THRESHOLD << (row + 1)) / 1000, rows[row]);
+		}
+	}
+	printf("\n");
+}
+
+static void noise_report(void)
+{
+	uint32_t tsc_per_ms = apic_tsc_per_ms(), stolen_us;
+	struct noise_cpu *n;
+
+	printf("cpu     gaps  stolen us/s   max us   p99 us  loop cyc  smis\n");
+	for (uint8_t cpu = 0; cpu < cpus_up; cpu++) {
+		n = &noise[cpu];
+		stolen_us = (uint32_t) div_u64(div_u64(n->stolen * 1000, tsc_per_ms), NOISE_SECONDS);
+
+		printf("%3u %8u %12u %8u %8u %9u %5u\n", cpu, (uint32_t) n->gaps.n, stolen_us,
+			n->gaps.n ? n->gaps.max / 1000 : 0,
+			hist_quantile(&n->gaps, HIST_P99) / 1000, n->min_loop, n->smis);
+	}
+
+	for (uint8_t cpu = 0; cpu < cpus_up; cpu++) {
+		if (noise[cpu].gaps.n) {
+			noise_hist(cpu);
+		}
+	}
+}
+
+void __entry startup32()
+{
+	uint8_t apicid = __apicid();
+
+	x86_basic_init(0);
+
+	if (apicid != 0) {
+		__asm__ volatile ("lock incl %0" : "+m" (cpus_up) :: "memory");
+		while (!go) {
+			__asm__ volatile ("pause");
+		}
+
+		noise_run(apicid);
+		__asm__ volatile ("lock incl %0" : "+m" (cpus_done) :: "memory");
+		__halt();
+	}
+
+	puts("[smi_detect]: start\n");
+	for (uint8_t i = 1; i < MAXCPU; i++) {
+		apic_init_thread(i, startup32);
+		apic_timer_wait_ms(100);
+	}
+
+	has_smi_count = smi_count_supported();
+	barrier_init(&start_barrier, BARRIER_CENTRAL, cpus_up);
+	printf("%u cpus, %u s, gaps above %u ns, interrupts masked, MSR_SMI_COUNT %s\n",
+		cpus_up, NOISE_SECONDS, NOISE_THRESHOLD, has_smi_count ? "read" : "n/a");
+	go = 1;
+
+	noise_run(0);
+	while (cpus_done != cpus_up - 1) {
+		__asm__ volatile ("pause");
+	}
+
+	noise_report();
+
+	puts("[smi_detect]: end\n");
+	payload_done();
+}
@@ -4,6 +4,7 @@
 
 #include "cpu.h"
 #include "video.h"
+#include "trace.h"
 #include "lapic.h"
 #include "paging.h"
 #include "compiler.h"
@@ -13,7 +14,7 @@ typedef struct _stack32 {
 	uint8_t d[1024];
 } __align(16) stack32_t;
 
-stack32_t __use_section_data pcpu_stack_32[MAXCPU];
+stack32_t pcpu_stack_32[MAXCPU];
 
 static inline __attribute__((always_inline))
 void set_thread_stack(void)
@@ -34,18 +35,26 @@ void x86_basic_init()
 	sti();
 }
 
-void __attribute__((noreturn)) startup32()
+void __entry startup32()
 {
 	uint8_t apicid = __apicid();
 	x86_basic_init();
+	if (apicid == 0) {
+		trace_init();
+	}
+
 	printf("cpu %d: initialized\n", apicid);
+	trace("cpu %u: initialized", apicid);
 
 	if (apicid == 0) {
 		for (uint8_t i = 1; i < MAXCPU; i++) {
 			printf("cpu %d: trying to wake up ap %d...\n", apicid, i);
+			trace("cpu %u: sipi to ap %u", apicid, i);
 			apic_init_thread(i, startup32);
 			apic_timer_wait_ms(1000);
 		}
+
+		payload_done();
 	}
 
 	__halt();
@@ -0,0 +1,33 @@
+/*
+ * spinlock.h - test and test-and-set lock
+ */
+
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include "inttypes.h"
+
+static inline void spin_lock(volatile uint32_t *lock)
+{
+	uint32_t v = 1;
+
+	for (;;) {
+		__asm__ volatile ("xchgl %0, %1" : "+r" (v), "+m" (*lock) :: "memory");
+		if (!v) {
+			return;
+		}
+
+		while (*lock) {
+			__asm__ volatile ("pause");
+		}
+		v = 1;
+	}
+}
+
+static inline void spin_unlock(volatile uint32_t *lock)
+{
+	__asm__ volatile ("" ::: "memory");
+	*lock = 0;
+}
+
+#endif
@@ -2,11 +2,28 @@
  * string.c
  */
 
+#include "cpu.h"
 #include "string.h"
+#include "compiler.h"
 #include "inttypes.h"
 
+typedef void *(*memcpy_fn_t)(void *dst, const void *src, uint32_t n);
+typedef void *(*memset_fn_t)(void *dst, int c, uint32_t n);
 
-void memcpy(void *dst, const void *src, uint32_t n)
+/* unbound (zero) means generic, bound once by string_init */
+static memcpy_fn_t __use_section_data memcpy_fn = 0;
+static memcpy_fn_t __use_section_data memcpy_large_fn = 0;
+static memcpy_fn_t __use_section_data memmove_back_fn = 0;
+static memset_fn_t __use_section_data memset_fn = 0;
+static memset_fn_t __use_section_data memset_large_fn = 0;
+
+/* non-temporal above this size (llc) */
+static uint32_t __use_section_data nt_threshold = 0xffffffff;
+
+uint32_t __use_section_data string_features = 0;
+
+
+void *memcpy_generic(void *dst, const void *src, uint32_t n)
 {
 	char *d = dst;
 	const char *s = src;
@@ -14,6 +31,91 @@ void memcpy(void *dst, const void *src, uint32_t n)
 	while (n--) {
 		*d++ = *s++;
 	}
+
+	return dst;
+}
+
+void *memcpy_movsd(void *dst, const void *src, uint32_t n)
+{
+	void *d = dst;
+	uint32_t words = n >> 2, bytes = n & 3;
+
+	__asm__ volatile ("rep movsl\n\t"
+		"mov %3, %%ecx\n\t"
+		"rep movsb"
+		: "+D"(d), "+S"(src), "+c"(words)
+		: "r"(bytes)
+		: "memory");
+
+	return dst;
+}
+
+void *memcpy_erms(void *dst, const void *src, uint32_t n)
+{
+	void *d = dst;
+	__asm__ volatile ("rep movsb" : "+D"(d), "+S"(src), "+c"(n) :: "memory");
+	return dst;
+}
+
+void *memset_generic(void *dst, int c, uint32_t n)
+{
+	char *d = dst;
+
+	while (n--) {
+		*d++ = (char) c;
+	}
+
+	return dst;
+}
+
+void *memset_erms(void *dst, int c, uint32_t n)
+{
+	void *d = dst;
+	__asm__ volatile ("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+	return dst;
+}
+
+void *memmove_back_generic(void *dst, const void *src, uint32_t n)
+{
+	char *d = (char *) dst + n;
+	const char *s = (const char *) src + n;
+
+	while (n--) {
+		*--d = *--s;
+	}
+
+	return dst;
+}
+
+void *memcpy(void *dst, const void *src, uint32_t n)
+{
+	if (n >= nt_threshold) {
+		return memcpy_large_fn(dst, src, n);
+	}
+
+	return memcpy_fn ? memcpy_fn(dst, src, n) : memcpy_generic(dst, src, n);
+}
+
+void *memmove(void *dst, const void *src, uint32_t n)
+{
+	const char *d = dst, *s = src;
+
+	/* forward copy is safe unless dst overlaps the end of src */
+	if ((d <= s) || (d >= (s + n))) {
+		return memcpy(dst, src, n);
+	}
+
+	return memmove_back_fn ? memmove_back_fn(dst, src, n) :
+		memmove_back_generic(dst, src, n);
+}
+
+void *memset(void *dst, int c, uint32_t n)
+{
+	if (n >= nt_threshold) {
+		return memset_large_fn(dst, c, n);
+	}
+
+	return memset_fn ? memset_fn(dst, c, n) : memset_generic(dst, c, n);
 }
 
 int memcmp(const void *s1, const void *s2, uint32_t n)
@@ -33,3 +135,50 @@ int memcmp(const void *s1, const void *s2, uint32_t n)
 
 	return 0;
 }
+
+void string_init(void)
+{
+	uint32_t a = 1, b = 0, c = 0, d = 0;
+	uint32_t features = 0, llc;
+
+	__cpuid(&a, &b, &c, &d);
+	if (d & CPUID_1_EDX_SSE2) {
+		features |= STRING_F_SSE2;
+	}
+
+	a = 0;
+	__cpuid(&a, &b, &c, &d);
+	if (a >= 7) {
+		a = 7;
+		c = 0;
+		__cpuid(&a, &b, &c, &d);
+		features |= (b & CPUID_7_EBX_ERMS) ? STRING_F_ERMS : 0;
+		features |= (d & CPUID_7_EDX_FSRM) ? STRING_F_FSRM : 0;
+	}
+
+	/* rep movsb/stosb when the cpu says it's fast, sse2 otherwise */
+	memcpy_fn = memcpy_movsd;
+	memset_fn = memset_erms;
+	memmove_back_fn = memmove_back_generic;
+
+	if (features & STRING_F_SSE2) {
+		memcpy_fn = memcpy_sse2;
+		memset_fn = memset_sse2;
+		memmove_back_fn = memmove_back_sse2;
+	}
+
+	if (features & (STRING_F_ERMS | STRING_F_FSRM)) {
+		memcpy_fn = memcpy_erms;
+		memset_fn = memset_erms;
+	}
+
+	/* bypass the caches for copies that would evict the whole llc */
+	llc = x86_llc_size();
+	if ((features & STRING_F_SSE2) && llc) {
+		memcpy_large_fn = memcpy_nt;
+		memset_large_fn = memset_nt;
+		nt_threshold = llc;
+	}
+
+	string_features = features;
+}
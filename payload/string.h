@@ -7,7 +7,35 @@
 
 #include "inttypes.h"
 
-void memcpy(void *dst, const void *src, uint32_t n);
+/* string_features */
+#define STRING_F_SSE2 1
+#define STRING_F_ERMS 2 /* enhanced rep movsb/stosb */
+#define STRING_F_FSRM 4 /* fast short rep movsb */
+
+extern uint32_t string_features;
+
+/* bind the fastest variants, needs sse enabled (x86_cpu_init) */
+void string_init(void);
+
+/* the sse2 variants clobber xmm registers: not for __interrupt handlers */
+void *memcpy(void *dst, const void *src, uint32_t n);
+void *memmove(void *dst, const void *src, uint32_t n);
+void *memset(void *dst, int c, uint32_t n);
 int memcmp(const void *s1, const void *s2, uint32_t n);
 
+/* variants, exported for benchmarks */
+void *memcpy_generic(void *dst, const void *src, uint32_t n);
+void *memcpy_movsd(void *dst, const void *src, uint32_t n);
+void *memcpy_erms(void *dst, const void *src, uint32_t n);
+void *memcpy_sse2(void *dst, const void *src, uint32_t n);
+void *memcpy_nt(void *dst, const void *src, uint32_t n);
+
+void *memset_generic(void *dst, int c, uint32_t n);
+void *memset_erms(void *dst, int c, uint32_t n);
+void *memset_sse2(void *dst, int c, uint32_t n);
+void *memset_nt(void *dst, int c, uint32_t n);
+
+void *memmove_back_generic(void *dst, const void *src, uint32_t n);
+void *memmove_back_sse2(void *dst, const void *src, uint32_t n);
+
 #endif
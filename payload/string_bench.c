@@ -0,0 +1,171 @@
+/*
+ * string_bench.c - memcpy/memset variants, bytes per cycle
+ */
+
+#include "cpu.h"
+#include "video.h"
+#include "div64.h"
+#include "string.h"
+#include "compiler.h"
+
+/* paging stays off, buffers well above the payload */
+#define BENCH_SRC     0x1000000
+#define BENCH_DST     0x2000000
+#define BENCH_REPS    5
+#define BENCH_MINRUN  0x40000 /* small sizes are repeated up to this */
+
+#define NUMVARIANTS   5
+#define NUMSIZES      (sizeof(sizes) / sizeof(sizes[0]))
+
+typedef void *(*copy_fn_t)(void *dst, const void *src, uint32_t n);
+typedef void *(*set_fn_t)(void *dst, int c, uint32_t n);
+
+static const uint32_t sizes[] = {
+	64, 256, 1024, 4096, 16384, 65536, 262144, 1048576, 8388608
+};
+
+/* no pointer tables: the image isn't relocated */
+static const char names[NUMVARIANTS][8] = {
+	"generic", "movsd", "erms", "sse2", "nt"
+};
+
+/* best of BENCH_REPS, in bytes per cycle * 100 */
+static uint32_t to_rate(uint32_t size, uint32_t iters, uint64_t best)
+{
+	if (best >> 32) {
+		best = 0xffffffff;
+	}
+
+	return (uint32_t) div_u64((uint64_t) size * iters * 100, (uint32_t) best);
+}
+
+static uint32_t bench_copy(copy_fn_t fn, uint32_t size)
+{
+	uint32_t iters = (size < BENCH_MINRUN) ? BENCH_MINRUN / size : 1;
+	uint64_t t, best = ~0ull;
+
+	fn((void *) BENCH_DST, (void *) BENCH_SRC, size);
+
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		t = rdtsc();
+		for (uint32_t i = 0; i < iters; i++) {
+			fn((void *) BENCH_DST, (void *) BENCH_SRC, size);
+		}
+		t = rdtsc() - t;
+
+		if (t < best) {
+			best = t;
+		}
+	}
+
+	return to_rate(size, iters, best);
+}
+
+static uint32_t bench_set(set_fn_t fn, uint32_t size)
+{
+	uint32_t iters = (size < BENCH_MINRUN) ? BENCH_MINRUN / size : 1;
+	uint64_t t, best = ~0ull;
+
+	fn((void *) BENCH_DST, 0x5a, size);
+
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		t = rdtsc();
+		for (uint32_t i = 0; i < iters; i++) {
+			fn((void *) BENCH_DST, 0x5a, size);
+		}
+		t = rdtsc() - t;
+
+		if (t < best) {
+			best = t;
+		}
+	}
+
+	return to_rate(size, iters, best);
+}
+
+static void print_header(const char *what)
+{
+	printf("%-8s", what);
+	for (int v = 0; v < NUMVARIANTS; v++) {
+		printf("%9s", names[v]);
+	}
+	putchar('\n');
+}
+
+static void print_rate(uint32_t rate, int supported)
+{
+	if (!supported) {
+		printf("%9s", "-");
+		return;
+	}
+
+	printf("%6u.%02u", rate / 100, rate % 100);
+}
+
+static void print_size(uint32_t size)
+{
+	if (size >= 0x100000) {
+		printf("%6uM  ", size >> 20);
+	} else if (size >= 0x400) {
+		printf("%6uK  ", size >> 10);
+	} else {
+		printf("%6u   ", size);
+	}
+}
+
+void __entry startup32()
+{
+	copy_fn_t copy[NUMVARIANTS];
+	set_fn_t set[NUMVARIANTS];
+	int sse2;
+
+	cli();
+	x86_cpu_init();
+
+	/* assigned at runtime, see names */
+	copy[0] = memcpy_generic;
+	copy[1] = memcpy_movsd;
+	copy[2] = memcpy_erms;
+	copy[3] = memcpy_sse2;
+	copy[4] = memcpy_nt;
+
+	set[0] = memset_generic;
+	set[1] = memset_generic; /* no movsd variant */
+	set[2] = memset_erms;
+	set[3] = memset_sse2;
+	set[4] = memset_nt;
+
+	sse2 = string_features & STRING_F_SSE2;
+
+	puts("[string_bench]: start\n");
+	printf("features:%s%s%s, llc %u KiB (bytes/cycle)\n",
+		sse2 ? " sse2" : "",
+		(string_features & STRING_F_ERMS) ? " erms" : "",
+		(string_features & STRING_F_FSRM) ? " fsrm" : "",
+		x86_llc_size() >> 10);
+
+	memset_generic((void *) BENCH_SRC, 0xa5, sizes[NUMSIZES - 1]);
+
+	print_header("memcpy");
+	for (uint32_t i = 0; i < NUMSIZES; i++) {
+		print_size(sizes[i]);
+		for (int v = 0; v < NUMVARIANTS; v++) {
+			int ok = (v < 3) || sse2;
+			print_rate(ok ? bench_copy(copy[v], sizes[i]) : 0, ok);
+		}
+		putchar('\n');
+	}
+
+	print_header("memset");
+	for (uint32_t i = 0; i < NUMSIZES; i++) {
+		print_size(sizes[i]);
+		for (int v = 0; v < NUMVARIANTS; v++) {
+			int ok = ((v < 3) || sse2) && (v != 1);
+			print_rate(ok ? bench_set(set[v], sizes[i]) : 0, ok);
+		}
+		putchar('\n');
+	}
+
+	puts("[string_bench]: end\n");
+	payload_done();
+}
@@ -0,0 +1,171 @@
+/*
+ * string_sse.c - sse2 variants (built with -msse2)
+ */
+
+#include "string.h"
+#include "inttypes.h"
+
+#define PREFETCH_DIST 512
+
+/* gcc vector types, the intrinsics headers want a hosted libc */
+typedef long long v2di __attribute__((vector_size(16), may_alias));
+typedef long long v2di_u __attribute__((vector_size(16), aligned(1), may_alias));
+
+#define load_u(p)      (*(const v2di_u *) (p))
+#define store_a(p, x)  (*(v2di *) (p) = (x))
+#define store_nt(p, x) __builtin_ia32_movntdq((v2di *) (p), (x))
+
+static inline int misaligned(const void *p)
+{
+	return ((unsigned long) p) & 15;
+}
+
+void *memcpy_sse2(void *dst, const void *src, uint32_t n)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	v2di x0, x1, x2, x3;
+
+	/* align the destination, stores matter more than loads */
+	while (n && misaligned(d)) {
+		*d++ = *s++;
+		n--;
+	}
+
+	for (; n >= 64; n -= 64, d += 64, s += 64) {
+		x0 = load_u(s + 0);
+		x1 = load_u(s + 16);
+		x2 = load_u(s + 32);
+		x3 = load_u(s + 48);
+		store_a(d + 0, x0);
+		store_a(d + 16, x1);
+		store_a(d + 32, x2);
+		store_a(d + 48, x3);
+	}
+
+	for (; n >= 16; n -= 16, d += 16, s += 16) {
+		store_a(d, load_u(s));
+	}
+
+	while (n--) {
+		*d++ = *s++;
+	}
+
+	return dst;
+}
+
+void *memcpy_nt(void *dst, const void *src, uint32_t n)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	v2di x0, x1, x2, x3;
+
+	while (n && misaligned(d)) {
+		*d++ = *s++;
+		n--;
+	}
+
+	for (; n >= 64; n -= 64, d += 64, s += 64) {
+		__builtin_prefetch(s + PREFETCH_DIST, 0, 0);
+		x0 = load_u(s + 0);
+		x1 = load_u(s + 16);
+		x2 = load_u(s + 32);
+		x3 = load_u(s + 48);
+		store_nt(d + 0, x0);
+		store_nt(d + 16, x1);
+		store_nt(d + 32, x2);
+		store_nt(d + 48, x3);
+	}
+
+	/* order the weakly-ordered stores before the tail */
+	__builtin_ia32_sfence();
+	memcpy_sse2(d, s, n);
+	return dst;
+}
+
+void *memset_sse2(void *dst, int c, uint32_t n)
+{
+	uint8_t *d = dst;
+	uint64_t pat = 0x0101010101010101ull * (uint8_t) c;
+	v2di x = { (long long) pat, (long long) pat };
+
+	while (n && misaligned(d)) {
+		*d++ = (uint8_t) c;
+		n--;
+	}
+
+	for (; n >= 64; n -= 64, d += 64) {
+		store_a(d + 0, x);
+		store_a(d + 16, x);
+		store_a(d + 32, x);
+		store_a(d + 48, x);
+	}
+
+	for (; n >= 16; n -= 16, d += 16) {
+		store_a(d, x);
+	}
+
+	while (n--) {
+		*d++ = (uint8_t) c;
+	}
+
+	return dst;
+}
+
+void *memset_nt(void *dst, int c, uint32_t n)
+{
+	uint8_t *d = dst;
+	uint64_t pat = 0x0101010101010101ull * (uint8_t) c;
+	v2di x = { (long long) pat, (long long) pat };
+
+	while (n && misaligned(d)) {
+		*d++ = (uint8_t) c;
+		n--;
+	}
+
+	for (; n >= 64; n -= 64, d += 64) {
+		store_nt(d + 0, x);
+		store_nt(d + 16, x);
+		store_nt(d + 32, x);
+		store_nt(d + 48, x);
+	}
+
+	__builtin_ia32_sfence();
+	memset_sse2(d, c, n);
+	return dst;
+}
+
+/* overlapping, dst above src: copy from the end */
+void *memmove_back_sse2(void *dst, const void *src, uint32_t n)
+{
+	uint8_t *d = (uint8_t *) dst + n;
+	const uint8_t *s = (const uint8_t *) src + n;
+	v2di x0, x1;
+
+	while (n && misaligned(d)) {
+		*--d = *--s;
+		n--;
+	}
+
+	/* load both halves before storing, they may overlap */
+	for (; n >= 32; n -= 32) {
+		d -= 32;
+		s -= 32;
+		x0 = load_u(s + 16);
+		x1 = load_u(s + 0);
+		store_a(d + 16, x0);
+		store_a(d + 0, x1);
+	}
+
+	for (; n >= 16; n -= 16) {
+		d -= 16;
+		s -= 16;
+		store_a(d, load_u(s));
+	}
+
+	while (n--) {
+		*--d = *--s;
+	}
+
+	return dst;
+}
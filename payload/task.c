@@ -0,0 +1,339 @@
+/*
+ * task.c - chase-lev work-stealing deques, one per cpu
+ *
+ * parallel_for splits its range in halves, pushes the right half on the
+ * caller's deque and recurses into the left one. tasks live on the stack
+ * of the splitting cpu, it doesn't return before the other half is done and
+ * runs or steals other tasks while it waits. aps sit in task_worker:
+ * pop, steal from a random victim, park in hlt until an ipi.
+ */
+
+#include "cpu.h"
+#include "idt.h"
+#include "task.h"
+#include "lapic.h"
+#include "compiler.h"
+
+#define STEAL_ROUNDS 64   /* failed steal rounds before parking */
+
+struct task_deque {
+	volatile int32_t top;       /* thieves take from here */
+	uint32_t pad0[15];
+	volatile int32_t bottom;    /* owner pushes and pops here */
+	uint32_t seed;
+	uint32_t steals;
+	uint32_t parks;
+	struct task *volatile buf[TASK_DEQUE_SIZE];
+} __align(64);
+
+struct task_deque task_deque[MAXCPU];
+volatile uint32_t __use_section_data task_online = 0;   /* cpu mask */
+volatile uint32_t __use_section_data task_parked = 0;   /* cpu mask */
+volatile uint32_t __use_section_data task_limit = MAXCPU;
+
+static inline int32_t cmpxchg(volatile int32_t *p, int32_t old, int32_t new)
+{
+	__asm__ volatile ("lock cmpxchgl %2, %1"
+		: "+a" (old), "+m" (*p) : "r" (new) : "memory");
+	return old;
+}
+
+static inline void mask_set(volatile uint32_t *mask, uint32_t cpu)
+{
+	__asm__ volatile ("lock btsl %1, %0" : "+m" (*mask) : "r" (cpu) : "memory");
+}
+
+/* 1 if this call cleared the bit */
+static inline int mask_clear(volatile uint32_t *mask, uint32_t cpu)
+{
+	uint8_t was;
+
+	__asm__ volatile ("lock btrl %2, %0; setc %1"
+		: "+m" (*mask), "=q" (was) : "r" (cpu) : "memory", "cc");
+	return was;
+}
+
+static inline void barrier(void)
+{
+	__asm__ volatile ("" ::: "memory");
+}
+
+static inline void mfence(void)
+{
+	__asm__ volatile ("mfence" ::: "memory");
+}
+
+/* -1 when full */
+static int deque_push(struct task_deque *d, struct task *t)
+{
+	int32_t b = d->bottom;
+
+	if (b - d->top >= TASK_DEQUE_SIZE) {
+		return -1;
+	}
+
+	d->buf[b & (TASK_DEQUE_SIZE - 1)] = t;
+	barrier();
+	d->bottom = b + 1;
+	return 0;
+}
+
+/* owner end, races thieves only for the last task */
+static struct task *deque_pop(struct task_deque *d)
+{
+	int32_t b = d->bottom - 1, t;
+	struct task *task;
+
+	d->bottom = b;
+	mfence();
+	t = d->top;
+
+	if (t > b) {
+		d->bottom = b + 1;
+		return 0;
+	}
+
+	task = d->buf[b & (TASK_DEQUE_SIZE - 1)];
+	if (t == b) {
+		if (cmpxchg(&d->top, t, t + 1) != t) {
+			task = 0;
+		}
+		d->bottom = b + 1;
+	}
+
+	return task;
+}
+
+static struct task *deque_steal(struct task_deque *d)
+{
+	int32_t t = d->top, b;
+	struct task *task;
+
+	barrier();
+	b = d->bottom;
+	if (t >= b) {
+		return 0;
+	}
+
+	task = d->buf[t & (TASK_DEQUE_SIZE - 1)];
+	if (cmpxchg(&d->top, t, t + 1) != t) {
+		return 0;
+	}
+
+	return task;
+}
+
+static inline uint32_t xorshift32(uint32_t x)
+{
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+static inline uint32_t allowed(void)
+{
+	return task_online & ((1u << task_limit) - 1);
+}
+
+/* one round over the other cpus, random start */
+static struct task *steal(uint8_t cpu)
+{
+	struct task_deque *d = &task_deque[cpu];
+	uint32_t mask = allowed(), victim;
+	struct task *t;
+
+	d->seed = xorshift32(d->seed);
+	for (uint32_t i = 0; i < MAXCPU; i++) {
+		victim = (d->seed + i) % MAXCPU;
+		if (victim == cpu || !(mask & (1u << victim))) {
+			continue;
+		}
+
+		if ((t = deque_steal(&task_deque[victim]))) {
+			d->steals++;
+			return t;
+		}
+	}
+
+	return 0;
+}
+
+static int work_queued(void)
+{
+	for (uint32_t cpu = 0; cpu < MAXCPU; cpu++) {
+		if (task_deque[cpu].bottom - task_deque[cpu].top > 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* a parked worker for new work, if any */
+static void wake_one(void)
+{
+	uint32_t mask;
+
+	/*
+	 * the push's store to bottom before the task_parked load, park() does
+	 * the reverse: either it sees the work or this sees it parked
+	 */
+	mfence();
+	mask = task_parked & allowed();
+
+	while (mask) {
+		uint32_t cpu = __builtin_ctz(mask);
+
+		if (mask_clear(&task_parked, cpu)) {
+			apic_send_ipi(cpu, 0, IPI_MODE_FIXED, TASK_WAKE_VECTOR);
+			return;
+		}
+		mask &= mask - 1;
+	}
+}
+
+static void task_wake(isr_regs_t *regs __attribute__((unused)))
+{
+	apic_eoi();
+}
+
+static void pfor_range(struct task *t);
+
+static void task_run(struct task *t)
+{
+	pfor_range(t);
+	barrier();
+	t->done = 1;
+}
+
+static void pfor_range(struct task *t)
+{
+	struct task_deque *d = &task_deque[apic_id()];
+	struct task right, *other;
+	uint32_t mid;
+
+	if (t->end - t->begin <= t->grain) {
+		t->fn(t->begin, t->end, t->arg);
+		return;
+	}
+
+	mid = t->begin + (t->end - t->begin) / 2;
+	right = (struct task) { t->fn, t->arg, mid, t->end, t->grain, 0 };
+
+	if (deque_push(d, &right) < 0) {
+		task_run(&right);
+	} else {
+		wake_one();
+	}
+
+	pfor_range(&(struct task) { t->fn, t->arg, t->begin, mid, t->grain, 0 });
+
+	/* usually pops right itself, else helps whoever stole it */
+	while (!right.done) {
+		if ((other = deque_pop(d)) || (other = steal(apic_id()))) {
+			task_run(other);
+		} else {
+			__asm__ volatile ("pause");
+		}
+	}
+}
+
+/* each cpu after x86_cpu_init and apic_init, bsp first */
+int task_init(void)
+{
+	uint8_t cpu = __apicid();
+	struct task_deque *d;
+
+	if (cpu >= MAXCPU) {
+		return -1;
+	}
+
+	d = &task_deque[cpu];
+	d->top = d->bottom = 0;
+	d->seed = 0x9e3779b9 * (cpu + 1);
+	d->steals = d->parks = 0;
+
+	if (cpu == 0) {
+		idt_set_handler(TASK_WAKE_VECTOR, task_wake);
+	}
+
+	mask_set(&task_online, cpu);
+	return 0;
+}
+
+/* interrupts off until hlt: a wakeup between the check and hlt isn't lost */
+static void park(uint8_t cpu)
+{
+	cli();
+	mask_set(&task_parked, cpu);
+	mfence();
+
+	if (cpu < task_limit && work_queued()) {
+		mask_clear(&task_parked, cpu);
+		sti();
+		return;
+	}
+
+	task_deque[cpu].parks++;
+	__asm__ volatile ("sti; hlt" ::: "memory");
+	mask_clear(&task_parked, cpu);
+}
+
+/* an ap's loop after task_init */
+void task_worker(void)
+{
+	uint8_t cpu = apic_id();
+	struct task_deque *d = &task_deque[cpu];
+	uint32_t idle = 0;
+	struct task *t;
+
+	for (;;) {
+		if (cpu < task_limit && ((t = deque_pop(d)) || (t = steal(cpu)))) {
+			task_run(t);
+			idle = 0;
+		} else if (++idle < STEAL_ROUNDS) {
+			__asm__ volatile ("pause");
+		} else {
+			park(cpu);
+			idle = 0;
+		}
+	}
+}
+
+/* blocks until fn covered [begin, end), the caller works too */
+void parallel_for(uint32_t begin, uint32_t end, uint32_t grain, pfor_fn_t fn, void *arg)
+{
+	struct task t = { fn, arg, begin, end, grain ? grain : 1, 0 };
+
+	if (begin < end) {
+		pfor_range(&t);
+	}
+}
+
+/* cpus with a higher apic id stop taking work */
+void task_set_cpus(uint32_t ncpus)
+{
+	task_limit = (ncpus < 1) ? 1 : (ncpus > MAXCPU) ? MAXCPU : ncpus;
+}
+
+uint32_t task_cpus(void)
+{
+	uint32_t mask = allowed(), n = 0;
+
+	for (; mask; mask &= mask - 1) {
+		n++;
+	}
+
+	return n;
+}
+
+uint32_t task_steals(uint8_t cpu)
+{
+	return (cpu < MAXCPU) ? task_deque[cpu].steals : 0;
+}
+
+uint32_t task_parks(uint8_t cpu)
+{
+	return (cpu < MAXCPU) ? task_deque[cpu].parks : 0;
+}
@@ -0,0 +1,31 @@
+/*
+ * task.h - work-stealing task runtime, parallel_for over every cpu
+ */
+
+#ifndef TASK_H
+#define TASK_H
+
+#include "inttypes.h"
+
+#define TASK_DEQUE_SIZE  256    /* power of two, a full deque runs tasks inline */
+#define TASK_WAKE_VECTOR 0x32   /* ipi to a parked worker */
+
+/* called with a subrange [begin, end) of at most grain indices */
+typedef void (*pfor_fn_t)(uint32_t begin, uint32_t end, void *arg);
+
+struct task {
+	pfor_fn_t fn;
+	void *arg;
+	uint32_t begin, end, grain;
+	volatile uint32_t done;
+};
+
+int task_init(void);
+void __attribute__((noreturn)) task_worker(void);
+void parallel_for(uint32_t begin, uint32_t end, uint32_t grain, pfor_fn_t fn, void *arg);
+void task_set_cpus(uint32_t ncpus);
+uint32_t task_cpus(void);
+uint32_t task_steals(uint8_t cpu);
+uint32_t task_parks(uint8_t cpu);
+
+#endif
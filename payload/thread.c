@@ -0,0 +1,353 @@
+/*
+ * thread.c - kernel threads, per cpu run queues, apic timer preemption
+ *
+ * threads stay on the cpu they were created for. the scheduler runs with
+ * interrupts off, from thread_yield or from the timer interrupt on the
+ * preempted thread's stack. the context that calls sched_start becomes
+ * the cpu's idle thread, it runs when the queue is empty.
+ */
+
+#include "cpu.h"
+#include "fpu.h"
+#include "idt.h"
+#include "numa.h"
+#include "div64.h"
+#include "video.h"
+#include "lapic.h"
+#include "thread.h"
+#include "spinlock.h"
+#include "compiler.h"
+
+#ifdef __x86_64__
+#define SWITCH_REGS 6   /* rbp rbx r12-r15 */
+#else
+#define SWITCH_REGS 4   /* ebp ebx esi edi */
+#endif
+
+struct runqueue {
+	volatile uint32_t lock;
+	uint32_t started;
+	struct thread *head, *tail;
+	struct thread *current;
+	struct thread *prev;      /* switched away from, for sched_finish */
+	struct thread *free;      /* dead threads, stacks reused */
+	struct thread idle;
+	uint32_t switches;
+	uint32_t preempts;
+} __align(64);
+
+struct runqueue runqueue[MAXCPU];
+volatile uint32_t __use_section_data thread_ids = 0;
+
+/* from switch.S */
+extern void thread_switch(uintptr_t *save_sp, uintptr_t sp);
+extern const char thread_entry[] __hidden;
+
+static inline struct runqueue *this_rq(void)
+{
+	return &runqueue[apic_id()];
+}
+
+static inline uint32_t next_id(void)
+{
+	uint32_t id = 1;
+
+	__asm__ volatile ("lock xaddl %0, %1" : "+r" (id), "+m" (thread_ids) :: "memory");
+	return id + 1;
+}
+
+static void enqueue(struct runqueue *rq, struct thread *t)
+{
+	t->next = 0;
+	if (rq->tail) {
+		rq->tail->next = t;
+	} else {
+		rq->head = t;
+	}
+	rq->tail = t;
+}
+
+static struct thread *dequeue(struct runqueue *rq)
+{
+	struct thread *t = rq->head;
+
+	if (t) {
+		rq->head = t->next;
+		if (!rq->head) {
+			rq->tail = 0;
+		}
+	}
+
+	return t;
+}
+
+/* on the new stack: the previous thread is off its stack now */
+static void sched_finish(struct runqueue *rq)
+{
+	struct thread *prev = rq->prev;
+
+	rq->prev = 0;
+	if (prev && prev->state == THREAD_DEAD && prev != &rq->idle) {
+		/* the registers hold next's state by now, only drop ownership */
+		fpu_ctx_release(&prev->fpu);
+		spin_lock(&rq->lock);
+		prev->next = rq->free;
+		rq->free = prev;
+		spin_unlock(&rq->lock);
+	}
+}
+
+/* interrupts off. 1 if another thread ran */
+static int schedule(struct runqueue *rq)
+{
+	struct thread *prev = rq->current, *next;
+
+	spin_lock(&rq->lock);
+	next = dequeue(rq);
+	if (!next) {
+		if (prev->state == THREAD_RUNNING) {
+			spin_unlock(&rq->lock);
+			return 0;
+		}
+		next = &rq->idle;
+	} else if (prev->state == THREAD_RUNNING && prev != &rq->idle) {
+		prev->state = THREAD_READY;
+		enqueue(rq, prev);
+	}
+	spin_unlock(&rq->lock);
+
+	next->state = THREAD_RUNNING;
+	rq->current = next;
+	rq->prev = prev;
+	rq->switches++;
+
+	fpu_switch(&next->fpu);
+	thread_switch(&prev->sp, next->sp);
+
+	sched_finish(this_rq());
+	return 1;
+}
+
+/* periodic apic timer, on the interrupted thread's stack */
+static void sched_tick(isr_regs_t *regs __attribute__((unused)))
+{
+	struct runqueue *rq = this_rq();
+
+	apic_eoi();
+	if (rq->started && schedule(rq)) {
+		rq->preempts++;
+	}
+}
+
+static void sched_ipi(isr_regs_t *regs __attribute__((unused)))
+{
+	struct runqueue *rq = this_rq();
+
+	apic_eoi();
+	if (rq->started) {
+		schedule(rq);
+	}
+}
+
+/* first run of a thread, called by thread_entry */
+void thread_start(void)
+{
+	struct runqueue *rq = this_rq();
+	struct thread *t = rq->current;
+
+	sched_finish(rq);
+	sti();
+
+	t->fn(t->arg);
+	thread_exit();
+}
+
+/* each cpu after x86_cpu_init and apic_init, bsp first */
+int sched_init(void)
+{
+	uint8_t cpu = __apicid();
+
+	if (cpu >= MAXCPU || fpu_init() < 0) {
+		return -1;
+	}
+
+	if (cpu == 0) {
+		idt_set_handler(SCHED_VECTOR, sched_tick);
+		idt_set_handler(SCHED_IPI_VECTOR, sched_ipi);
+	}
+
+	return 0;
+}
+
+/* the caller becomes the idle thread, time slice from the apic timer */
+void sched_start(uint32_t slice_us)
+{
+	struct runqueue *rq = this_rq();
+	uint32_t ticks = (uint32_t) div_u64((uint64_t) slice_us * apic_timer_ticks_per_ms(), 1000);
+	uintptr_t flags = irq_save();
+
+	rq->idle.state = THREAD_RUNNING;
+	rq->idle.cpu = apic_id();
+	rq->idle.id = next_id();
+	if (!rq->idle.fpu.area && fpu_ctx_init(&rq->idle.fpu, numa_node_of_cpu(apic_id())) < 0) {
+		printf("*** sched: no memory for the idle fpu area ***\n");
+		__halt();
+	}
+
+	fpu_switch(&rq->idle.fpu);
+	rq->current = &rq->idle;
+	rq->started = 1;
+
+	apic_timer_arm_periodic(SCHED_VECTOR, ticks ? ticks : 1);
+	irq_restore(flags);
+}
+
+/* the idle thread after sched_start: halt until something is queued */
+void sched_idle(void)
+{
+	struct runqueue *rq = this_rq();
+
+	for (;;) {
+		cli();
+		if (rq->head) {
+			schedule(rq);
+		}
+		__asm__ volatile ("sti; hlt");
+	}
+}
+
+static struct thread *thread_alloc(struct runqueue *rq, uint8_t cpu)
+{
+	uint32_t node = numa_node_of_cpu(cpu);
+	struct thread *t;
+	uintptr_t flags;
+
+	/* sched_tick takes the lock too, on this cpu it would spin forever */
+	flags = irq_save();
+	spin_lock(&rq->lock);
+	t = rq->free;
+	if (t) {
+		rq->free = t->next;
+	}
+	spin_unlock(&rq->lock);
+	irq_restore(flags);
+
+	/* a recycled thread starts from a clean fpu */
+	if (t) {
+		fpu_ctx_reset(&t->fpu);
+		return t;
+	}
+
+	t = numa_alloc(node, sizeof(*t), 64);
+	if (!t) {
+		return 0;
+	}
+
+	t->stack = numa_alloc(node, THREAD_STACK_SIZE, 16);
+	t->fpu.area = 0;
+	if (!t->stack || fpu_ctx_init(&t->fpu, node) < 0) {
+		return 0;
+	}
+
+	return t;
+}
+
+/* queued on cpu (needs sched_start there to run), 0 without memory */
+struct thread *thread_create(uint8_t cpu, thread_fn_t fn, void *arg)
+{
+	struct runqueue *rq;
+	struct thread *t;
+	uintptr_t *frame, flags;
+
+	if (cpu >= MAXCPU || !fn) {
+		return 0;
+	}
+
+	rq = &runqueue[cpu];
+	if (!(t = thread_alloc(rq, cpu))) {
+		return 0;
+	}
+
+	t->fn = fn;
+	t->arg = arg;
+	t->cpu = cpu;
+	t->id = next_id();
+	t->state = THREAD_READY;
+
+	/* zeroed callee-saved registers, return into thread_entry aligned */
+	frame = (uintptr_t *) (t->stack + THREAD_STACK_SIZE - 16) - (SWITCH_REGS + 1);
+	for (uint32_t i = 0; i < SWITCH_REGS; i++) {
+		frame[i] = 0;
+	}
+	frame[SWITCH_REGS] = (uintptr_t) thread_entry;
+	t->sp = (uintptr_t) frame;
+
+	flags = irq_save();
+	spin_lock(&rq->lock);
+	enqueue(rq, t);
+	spin_unlock(&rq->lock);
+	irq_restore(flags);
+
+	if (cpu != apic_id() && rq->started) {
+		apic_send_ipi(cpu, 0, IPI_MODE_FIXED, SCHED_IPI_VECTOR);
+	}
+
+	return t;
+}
+
+struct thread *thread_self(void)
+{
+	return this_rq()->current;
+}
+
+void thread_yield(void)
+{
+	uintptr_t flags = irq_save();
+
+	schedule(this_rq());
+	irq_restore(flags);
+}
+
+/* yields until t exited (or its slot went to a new thread) */
+void thread_join(struct thread *t)
+{
+	uint32_t id = t->id;
+
+	while (t->id == id && t->state != THREAD_DEAD) {
+		thread_yield();
+		__asm__ volatile ("pause");
+	}
+}
+
+/* tsc based, other threads run meanwhile */
+void thread_sleep_us(uint32_t usec)
+{
+	uint64_t end = rdtsc() + div_u64((uint64_t) usec * apic_tsc_per_ms(), 1000);
+
+	while (rdtsc() < end) {
+		thread_yield();
+	}
+}
+
+void thread_exit(void)
+{
+	struct runqueue *rq;
+
+	cli();
+	rq = this_rq();
+	rq->current->state = THREAD_DEAD;
+	schedule(rq);
+
+	/* idle can't exit: nothing else runs on this cpu */
+	__halt();
+}
+
+uint32_t sched_switches(uint8_t cpu)
+{
+	return (cpu < MAXCPU) ? runqueue[cpu].switches : 0;
+}
+
+uint32_t sched_preemptions(uint8_t cpu)
+{
+	return (cpu < MAXCPU) ? runqueue[cpu].preempts : 0;
+}
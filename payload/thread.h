@@ -0,0 +1,45 @@
+/*
+ * thread.h - kernel threads, per cpu run queues, apic timer preemption
+ */
+
+#ifndef THREAD_H
+#define THREAD_H
+
+#include "fpu.h"
+#include "inttypes.h"
+
+#define THREAD_STACK_SIZE 0x4000
+#define SCHED_VECTOR      0x30   /* apic timer, periodic */
+#define SCHED_IPI_VECTOR  0x31   /* thread queued from another cpu */
+
+#define THREAD_READY      0
+#define THREAD_RUNNING    1
+#define THREAD_DEAD       2
+
+typedef void (*thread_fn_t)(void *arg);
+
+struct thread {
+	uintptr_t sp;             /* saved by thread_switch */
+	struct thread *next;
+	thread_fn_t fn;
+	void *arg;
+	uint8_t *stack;
+	struct fpu_ctx fpu;
+	volatile uint32_t state;
+	volatile uint32_t id;
+	uint8_t cpu;
+};
+
+int sched_init(void);
+void sched_start(uint32_t slice_us);
+void __attribute__((noreturn)) sched_idle(void);
+struct thread *thread_create(uint8_t cpu, thread_fn_t fn, void *arg);
+struct thread *thread_self(void);
+void thread_yield(void);
+void thread_join(struct thread *t);
+void thread_sleep_us(uint32_t usec);
+void __attribute__((noreturn)) thread_exit(void);
+uint32_t sched_switches(uint8_t cpu);
+uint32_t sched_preemptions(uint8_t cpu);
+
+#endif
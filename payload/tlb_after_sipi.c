@@ -20,12 +20,12 @@ void x86_basic_init()
 	sti();
 }
 
-void __attribute__((noreturn)) startup32()
+void __entry startup32()
 {
 	x86_basic_init();
 	puts("[tlb_after_sipi]: start\n");
 	puts("*** not implemented ***\n");
 	puts("[tlb_after_sipi]: end\n");
-	__trap();
+	payload_done();
 }
 
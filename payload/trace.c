@@ -0,0 +1,45 @@
+/*
+ * trace.c
+ */
+
+#include "cpu.h"
+#include "video.h"
+#include "compiler.h"
+#include "trace.h"
+
+/* from script.ld */
+extern const char __payload_start[] __hidden;
+extern const char __trace_fmt_end[] __hidden;
+
+int __use_section_data trace_enabled = 0;
+
+uint32_t trace_area_size(void)
+{
+	return sizeof(struct trace_header) + MAXCPU * sizeof(struct trace_ring);
+}
+
+/* bsp only, before waking up the aps */
+void trace_init(void)
+{
+	struct trace_header *hdr = (struct trace_header *) TRACE_AREA;
+	struct trace_ring *ring;
+
+	hdr->magic = TRACE_MAGIC;
+	hdr->version = TRACE_VERSION;
+	hdr->ncpu = MAXCPU;
+	hdr->ring_size = TRACE_RING_SIZE;
+	hdr->fmt_offset = __trace_fmt_start - __payload_start;
+	hdr->fmt_size = __trace_fmt_end - __trace_fmt_start;
+	hdr->zero[0] = hdr->zero[1] = 0;
+
+	for (uint8_t i = 0; i < MAXCPU; i++) {
+		ring = trace_ring(i);
+		ring->magic = TRACE_MAGIC;
+		ring->cpu = i;
+		ring->head = 0;
+		ring->size = TRACE_RING_SIZE;
+	}
+
+	trace_enabled = 1;
+	printf("trace: area at 0x%x, %u bytes\n", TRACE_AREA, trace_area_size());
+}
@@ -0,0 +1,74 @@
+/*
+ * trace.h - deferred-format binary tracing
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "cpu.h"
+#include "lapic.h"
+#include "compiler.h"
+#include "inttypes.h"
+#include "tracebuf.h"
+
+/* split a 64-bit value for %llu / %llx */
+#define TRACE_U64(v) (uint32_t) (v), (uint32_t) ((uint64_t) (v) >> 32)
+
+extern const char __trace_fmt_start[] __hidden;
+extern int trace_enabled;
+
+/* only the format id and raw args are recorded, bmtrace formats them */
+#define trace(fmt, ...) do {                                           \
+	static const char __tfmt[]                                         \
+		__attribute__((section(".trace_fmt"), aligned(1))) = fmt;      \
+	const uint32_t __targs[] = { 0, ##__VA_ARGS__ };                   \
+	_Static_assert(sizeof(__targs) / 4 - 1 <= TRACE_MAXARGS,           \
+		"too many trace args");                                        \
+	__trace_write((uint16_t) (__tfmt - __trace_fmt_start),             \
+		sizeof(__targs) / 4 - 1, &__targs[1]);                         \
+} while (0)
+
+static inline struct trace_ring *trace_ring(uint8_t cpu)
+{
+	struct trace_header *hdr = (struct trace_header *) TRACE_AREA;
+	return &((struct trace_ring *) (hdr + 1))[cpu];
+}
+
+static inline __attribute__((always_inline))
+void __trace_write(uint16_t id, uint8_t nargs, const uint32_t *args)
+{
+	struct trace_record *rec;
+	struct trace_ring *ring;
+	uint32_t idx = 1;
+	uint8_t cpu;
+
+	if (!trace_enabled) {
+		return;
+	}
+
+	/* only MAXCPU rings, a sparse apic id past them is dropped */
+	cpu = apic_id();
+	if (cpu >= MAXCPU) {
+		return;
+	}
+
+	ring = trace_ring(cpu);
+
+	/* no lock prefix, the ring is only written by this cpu */
+	__asm__ volatile ("xaddl %0, %1" : "+r"(idx), "+m"(ring->head));
+
+	rec = &ring->rec[idx & (TRACE_RING_SIZE - 1)];
+	rec->tsc = rdtsc();
+	rec->id = id;
+	rec->nargs = nargs;
+	rec->cpu = cpu;
+
+	for (uint8_t i = 0; i < nargs; i++) {
+		rec->args[i] = args[i];
+	}
+}
+
+void trace_init(void);
+uint32_t trace_area_size(void);
+
+#endif
@@ -0,0 +1,191 @@
+/*
+ * tsc.c - cross cpu tsc offsets and warp check
+ *
+ * the bsp and one ap at a time bounce a cache line: bsp tsc before the
+ * request (t0) and after the reply (t2), the ap's tsc in between. the ap's
+ * offset is ap - (t0 + t2) / 2 from the shortest round trip, half of
+ * which is the uncertainty. then both take a shared lock and check that
+ * corrected reads never go backwards (warps).
+ */
+
+#include "cpu.h"
+#include "tsc.h"
+#include "lapic.h"
+#include "spinlock.h"
+#include "compiler.h"
+
+#define TSC_SYNC_TIMEOUT_MS 100
+
+enum {
+	SYNC_IDLE,
+	SYNC_SAMPLE,
+	SYNC_WARP,
+};
+
+struct tsc_mailbox {
+	volatile uint32_t cpu;      /* ap being measured */
+	volatile uint32_t ready;    /* that ap is in tsc_sync_ap */
+	volatile uint32_t phase;
+	volatile uint32_t seq;      /* odd: bsp asks, even: ap answered */
+	volatile uint64_t ap_tsc;
+	volatile uint32_t warp_done;
+	volatile uint32_t lock;
+	volatile uint64_t last;     /* warp test, corrected */
+} __align(64);
+
+struct tsc_cpu {
+	uint32_t uncertainty;
+	uint32_t warps;
+	uint32_t max_warp;
+};
+
+int64_t tsc_offsets[MAXCPU];
+struct tsc_cpu tsc_cpu[MAXCPU];
+struct tsc_mailbox __use_section_data tsc_mbox;
+
+/* not executed ahead of earlier loads */
+static inline uint64_t rdtsc_ordered(void)
+{
+	__asm__ volatile ("lfence" ::: "memory");
+	return rdtsc();
+}
+
+int tsc_invariant(void)
+{
+	uint32_t a = 0x80000000, b = 0, c = 0, d = 0;
+
+	__cpuid(&a, &b, &c, &d);
+	if (a < 0x80000007) {
+		return 0;
+	}
+
+	a = 0x80000007;
+	__cpuid(&a, &b, &c, &d);
+	return (d & CPUID_80000007_EDX_INVARIANT_TSC) != 0;
+}
+
+/* both sides at once, warps counted for the ap */
+static void warp_test(uint8_t cpu)
+{
+	struct tsc_cpu *t = &tsc_cpu[cpu];
+	int64_t offset = tsc_offsets[apic_id()];
+	uint64_t now;
+
+	for (uint32_t i = 0; i < TSC_WARP_ITERS; i++) {
+		spin_lock(&tsc_mbox.lock);
+		now = rdtsc_ordered() - (uint64_t) offset;
+		if ((int64_t) (now - tsc_mbox.last) < 0) {
+			t->warps++;
+			if (tsc_mbox.last - now > t->max_warp) {
+				t->max_warp = (uint32_t) (tsc_mbox.last - now);
+			}
+		}
+		tsc_mbox.last = now;
+		spin_unlock(&tsc_mbox.lock);
+	}
+}
+
+/* ap side, returns after the bsp measured this cpu */
+void tsc_sync_ap(void)
+{
+	uint8_t cpu = apic_id();
+
+	while (tsc_mbox.cpu != cpu) {
+		__asm__ volatile ("pause");
+	}
+	tsc_mbox.ready = 1;
+
+	for (uint32_t i = 0; i < TSC_SAMPLES; i++) {
+		while (tsc_mbox.seq != 2 * i + 1) {
+			__asm__ volatile ("pause");
+		}
+		tsc_mbox.ap_tsc = rdtsc_ordered();
+		tsc_mbox.seq = 2 * i + 2;
+	}
+
+	while (tsc_mbox.phase != SYNC_WARP) {
+		__asm__ volatile ("pause");
+	}
+
+	warp_test(cpu);
+	tsc_mbox.warp_done = 1;
+}
+
+/* bsp side, one ap at a time. -1 if it never called tsc_sync_ap */
+int tsc_sync_bsp(uint8_t cpu)
+{
+	uint64_t t0, t2, ap, rtt, best = ~0ull, deadline;
+	int64_t offset = 0;
+
+	if (cpu == 0 || cpu >= MAXCPU) {
+		return -1;
+	}
+
+	tsc_mbox.ready = 0;
+	tsc_mbox.seq = 0;
+	tsc_mbox.warp_done = 0;
+	tsc_mbox.phase = SYNC_SAMPLE;
+	tsc_mbox.cpu = cpu;
+
+	deadline = rdtsc() + (uint64_t) TSC_SYNC_TIMEOUT_MS * apic_tsc_per_ms();
+	while (!tsc_mbox.ready) {
+		if (rdtsc() > deadline) {
+			tsc_mbox.cpu = 0;
+			tsc_mbox.phase = SYNC_IDLE;
+			return -1;
+		}
+		__asm__ volatile ("pause");
+	}
+
+	for (uint32_t i = 0; i < TSC_SAMPLES; i++) {
+		t0 = rdtsc_ordered();
+		tsc_mbox.seq = 2 * i + 1;
+		while (tsc_mbox.seq != 2 * i + 2) {
+			__asm__ volatile ("pause");
+		}
+		t2 = rdtsc_ordered();
+		ap = tsc_mbox.ap_tsc;
+
+		rtt = t2 - t0;
+		if (rtt < best) {
+			best = rtt;
+			offset = (int64_t) (ap - (t0 + (rtt >> 1)));
+		}
+	}
+
+	tsc_offsets[cpu] = offset;
+	tsc_cpu[cpu].uncertainty = (uint32_t) (best >> 1);
+	tsc_cpu[cpu].warps = 0;
+	tsc_cpu[cpu].max_warp = 0;
+
+	tsc_mbox.last = 0;
+	tsc_mbox.phase = SYNC_WARP;
+	warp_test(cpu);
+	while (!tsc_mbox.warp_done) {
+		__asm__ volatile ("pause");
+	}
+
+	tsc_mbox.phase = SYNC_IDLE;
+	tsc_mbox.cpu = 0;
+	return 0;
+}
+
+int64_t tsc_offset(uint8_t cpu)
+{
+	return (cpu < MAXCPU) ? tsc_offsets[cpu] : 0;
+}
+
+uint32_t tsc_uncertainty(uint8_t cpu)
+{
+	return (cpu < MAXCPU) ? tsc_cpu[cpu].uncertainty : 0;
+}
+
+uint32_t tsc_warps(uint8_t cpu)
+{
+	return (cpu < MAXCPU) ? tsc_cpu[cpu].warps : 0;
+}
+
+uint32_t tsc_max_warp(uint8_t cpu)
+{
+	return (cpu < MAXCPU) ? tsc_cpu[cpu].max_warp : 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * tsc.h - cross cpu tsc offsets and warp check
+ */
+
+#ifndef TSC_H
+#define TSC_H
+
+#include "cpu.h"
+#include "lapic.h"
+#include "inttypes.h"
+
+#define TSC_SAMPLES     1000    /* round trips per ap, the shortest wins */
+#define TSC_WARP_ITERS  100000  /* locked reads per cpu in the warp test */
+
+#define CPUID_80000007_EDX_INVARIANT_TSC (1 << 8)
+
+/* tsc of this cpu minus the bsp's, set by tsc_sync_bsp */
+extern int64_t tsc_offsets[MAXCPU];
+
+int tsc_invariant(void);
+void tsc_sync_ap(void);
+int tsc_sync_bsp(uint8_t cpu);
+int64_t tsc_offset(uint8_t cpu);
+uint32_t tsc_uncertainty(uint8_t cpu);
+uint32_t tsc_warps(uint8_t cpu);
+uint32_t tsc_max_warp(uint8_t cpu);
+
+/* rdtsc on the bsp's time line */
+static inline uint64_t tsc_global(void)
+{
+	return rdtsc() - (uint64_t) tsc_offsets[apic_id()];
+}
+
+#endif
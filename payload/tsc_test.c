@@ -0,0 +1,45 @@
+/*
+ * tsc_test.c - invariant tsc, per ap offset, uncertainty and warps
+ */
+
+#include "cpu.h"
+#include "entry.h"
+#include "tsc.h"
+#include "video.h"
+#include "lapic.h"
+#include "compiler.h"
+
+PAYLOAD_STACKS(4096);
+
+void __entry startup32()
+{
+	uint8_t apicid = __apicid();
+
+	x86_basic_init(0);
+
+	if (apicid != 0) {
+		tsc_sync_ap();
+		__halt();
+	}
+
+	puts("[tsc_test]: start\n");
+	printf("invariant tsc: %s, %u samples, %u warp iterations per side\n",
+		tsc_invariant() ? "yes" : "no", TSC_SAMPLES, TSC_WARP_ITERS);
+	printf("cpu         offset  +/-  warps  max warp\n");
+
+	for (uint8_t i = 1; i < MAXCPU; i++) {
+		apic_init_thread(i, startup32);
+		apic_timer_wait_ms(100);
+
+		if (tsc_sync_bsp(i) < 0) {
+			printf("%3u not responding\n", i);
+			continue;
+		}
+
+		printf("%3u %14lld %4u %6u %9u%s\n", i, tsc_offset(i), tsc_uncertainty(i),
+			tsc_warps(i), tsc_max_warp(i), tsc_warps(i) ? "  *** WARP ***" : "");
+	}
+
+	puts("[tsc_test]: end\n");
+	payload_done();
+}
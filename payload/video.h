@@ -5,6 +5,8 @@
 #ifndef VIDEO_H
 #define VIDEO_H
 
+void __putchar(char c);
+void video_setcursor(void);
 void putchar(char c);
 void puts(const char *s);
 void printf(const char *fmt, ...)